@@ -1,4 +1,5 @@
 #include "dds.h"
+#include "dds_ftw.h"
 #include <gpio.h>
 #include <spi.h>
 #include <utils.h>
@@ -7,6 +8,9 @@
 
 #define DDS_SPI_TIMEOUT_MS 100
 
+#define DDS_SWEEP_TIMER TIM1
+#define DDS_SWEEP_TIMER_TICK_FREQ_HZ 1000000 // Timer counts microseconds
+
 #define DDS_XTAL_FREQ_FACTOR ((float)DDS_FREQ_REG_MAX_VALUE / DDS_XTAL_FREQ_HZ)
 #define DDS_PHASE_FACTOR ((float)DDS_PHASE_REG_MAX_VALUE / DDS_MAX_PHASE_DEG)
 
@@ -22,10 +26,17 @@
 #define DDS_DIV2_CTRL_BIT		(1 << 3)
 #define DDS_MODE_CTRL_BIT		(1 << 1)
 
+/* Frequency register write mode - both halves in B28 mode, selected by HLB otherwise */
+#define DDS_WRITE_MODE_MASK		(DDS_B28_CTRL_BIT | DDS_HLB_CTRL_BIT)
+#define DDS_WRITE_MODE_FULL		DDS_B28_CTRL_BIT
+#define DDS_WRITE_MODE_LSB		0
+#define DDS_WRITE_MODE_MSB		DDS_HLB_CTRL_BIT
+
 /* Frequency register bits */
 #define DDS_FREQ0_REG_MASK		(0x0001 << 14)
 #define DDS_FREQ1_REG_MASK		(0x0002 << 14)
 #define DDS_FREQ_REG_VALUE_MASK	(~(DDS_FREQ0_REG_MASK | DDS_FREQ1_REG_MASK))
+#define DDS_FREQ_REG_WORD_MASK	((1UL << DDS_FREQ_REG_BITS_PER_WORD) - 1)
 
 /* Phase register bits */
 #define DDS_PHASE0_REG_MASK			(0x000D << 12)
@@ -37,12 +48,21 @@
 #define DDS_PGA_SHUTDOWN_CMD	(0x02 << 4)
 #define DDS_PGA_POT_1_SELECT	(0x01 << 0)
 
-typedef enum
+/* Register bits for dirty tracking */
+#define DDS_REG_CTRL			(1 << 0)
+#define DDS_REG_FREQ(ch)		(1 << (1 + (ch)))
+#define DDS_REG_PHASE(ch)		(1 << (3 + (ch)))
+#define DDS_REG_PGA				(1 << 5)
+
+typedef struct
 {
-	DDS_SPI_MODE_UNKNOWN = 0,
-	DDS_SPI_MODE_0, // Required by MCP41010
-	DDS_SPI_MODE_2 	// Required by AD9833
-} dds_spi_mode_t;
+	uint32_t ftw[DDS_SWEEP_MAX_POINTS];
+	uint16_t points;
+	int16_t index;
+	int8_t step;
+	dds_sweep_direction_t direction;
+	volatile bool running;
+} dds_sweep_ctx_t;
 
 typedef struct
 {
@@ -50,76 +70,236 @@ typedef struct
 	dds_channel_t freq_ch;
 	dds_channel_t phase_ch;
 	uint16_t ctrl_reg;
-	float freq[DDS_CHANNEL_COUNT];
+	uint16_t hw_ctrl_reg; // Last control word actually written to the chip
+	uint32_t ftw[DDS_CHANNEL_COUNT];
+	uint32_t hw_ftw[DDS_CHANNEL_COUNT]; // Last tuning words actually written to the chip
+	uint16_t phase_reg[DDS_CHANNEL_COUNT];
 	float phase[DDS_CHANNEL_COUNT];
+	uint16_t pga_pot;
 	float amplitude;
-	dds_spi_mode_t spi_mode;
+	uint8_t dirty; // Registers whose shadow differs from the chip
+	uint8_t written; // Registers written at least once since init, contents of the others are unknown
+	uint8_t txn_depth;
+	uint32_t spi_frames;
+	dds_sweep_ctx_t sweep;
 } dds_ctx_t;
 
 static dds_ctx_t ctx;
 
+static const spi_device_t pga_spi_device = {
+	.mode = SPI_MODE_0, // Required by MCP41010
+	.cs_port = GPIO_SPI_PORT,
+	.cs_pin = GPIO_SPI_PGA_CS_PIN,
+	.data_size = SPI_DataSize_16b,
+	.prescaler = SPI_BaudRatePrescaler_8 // MCP41010 allows at most 10MHz clock
+};
+
+static const spi_device_t dds_spi_device = {
+	.mode = SPI_MODE_2, // Required by AD9833
+	.cs_port = GPIO_SPI_PORT,
+	.cs_pin = GPIO_SPI_DDS_CS_PIN,
+	.data_size = SPI_DataSize_16b,
+	.prescaler = SPI_BaudRatePrescaler_2
+};
+
 static int pga_spi_write(uint16_t data)
 {
-	if (ctx.spi_mode != DDS_SPI_MODE_0) {
-		SPI_HANDLE->CTLR1 &= ~SPI_CPOL_High;
-		ctx.spi_mode = DDS_SPI_MODE_0;
+	const int err = spi_queue_write(&pga_spi_device, data);
+	if (err) {
+		return err;
 	}
 
-	GPIO_WriteBit(GPIO_SPI_PORT, GPIO_SPI_PGA_CS_PIN, Bit_RESET);
-	const int err = spi_write(&data, 1); // SPI operates in 16-bit mode, hence size is 1
-	GPIO_WriteBit(GPIO_SPI_PORT, GPIO_SPI_PGA_CS_PIN, Bit_SET);
+	++ctx.spi_frames;
 
-	return err;
+	return 0;
 }
 
 static int dds_spi_write(uint16_t data)
 {
-	if (ctx.spi_mode != DDS_SPI_MODE_2) {
-		SPI_HANDLE->CTLR1 |= SPI_CPOL_High;
-		ctx.spi_mode = DDS_SPI_MODE_2;
+	const int err = spi_queue_write(&dds_spi_device, data);
+	if (err) {
+		return err;
 	}
 
-	GPIO_WriteBit(GPIO_SPI_PORT, GPIO_SPI_DDS_CS_PIN, Bit_RESET);
-	const int err = spi_write(&data, 1); // SPI operates in 16-bit mode, hence size is 1
-	GPIO_WriteBit(GPIO_SPI_PORT, GPIO_SPI_DDS_CS_PIN, Bit_SET);
+	++ctx.spi_frames;
 
-	return err;
+	return 0;
 }
 
-static int dds_write_frequency(uint32_t frequency, dds_channel_t channel)
+static int dds_get_freq_reg_mask(uint16_t *reg_mask, dds_channel_t channel)
 {
-	uint16_t hi_word;
-	uint16_t lo_word;
-
 	/* Select register to write */
 	switch (channel) {
 		case DDS_CH0:
-			hi_word = lo_word = DDS_FREQ0_REG_MASK;
+			*reg_mask = DDS_FREQ0_REG_MASK;
 			break;
 		case DDS_CH1:
-			hi_word = lo_word = DDS_FREQ1_REG_MASK;
+			*reg_mask = DDS_FREQ1_REG_MASK;
 			break;
 		default:
 			return -EINVAL;
 	}
 
-	/* Set value of each word */
-	hi_word |= (frequency >> DDS_FREQ_REG_BITS_PER_WORD) & DDS_FREQ_REG_VALUE_MASK;
-	lo_word |= frequency & DDS_FREQ_REG_VALUE_MASK;
+	return 0;
+}
+
+static int dds_pack_frequency(uint16_t *frames, uint32_t frequency, dds_channel_t channel)
+{
+	uint16_t reg_mask;
+
+	const int err = dds_get_freq_reg_mask(&reg_mask, channel);
+	if (err) {
+		return err;
+	}
+
+	/* Set value of each word, LSB goes first in B28 mode */
+	frames[0] = reg_mask | (frequency & DDS_FREQ_REG_VALUE_MASK);
+	frames[1] = reg_mask | ((frequency >> DDS_FREQ_REG_BITS_PER_WORD) & DDS_FREQ_REG_VALUE_MASK);
+
+	return 0;
+}
+
+static int dds_write_frequency(uint32_t frequency, dds_channel_t channel)
+{
+	uint16_t frames[DDS_STREAM_FRAMES_PER_FTW];
+
+	int err = dds_pack_frequency(frames, frequency, channel);
+	if (err) {
+		return err;
+	}
 
 	/* Write to chip */
-	int err = dds_spi_write(lo_word);
+	for (size_t i = 0; i < DDS_STREAM_FRAMES_PER_FTW; ++i) {
+		err = dds_spi_write(frames[i]);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static int dds_write_frequency_half(uint32_t frequency, bool msb, dds_channel_t channel)
+{
+	uint16_t reg_mask;
+
+	const int err = dds_get_freq_reg_mask(&reg_mask, channel);
 	if (err) {
 		return err;
 	}
-	err = dds_spi_write(hi_word);
+
+	if (msb) {
+		frequency >>= DDS_FREQ_REG_BITS_PER_WORD;
+	}
+
+	return dds_spi_write(reg_mask | (frequency & DDS_FREQ_REG_VALUE_MASK));
+}
+
+static void dds_sweep_fill_linear(uint32_t ftw_start, uint32_t ftw_stop, uint16_t points)
+{
+	const uint32_t segments = points - 1;
+	const bool rising = (ftw_stop >= ftw_start);
+	const uint32_t span = rising ? (ftw_stop - ftw_start) : (ftw_start - ftw_stop);
+
+	/* Spread division remainder evenly across the points, so that the last one lands exactly on ftw_stop */
+	const uint32_t step = span / segments;
+	const uint32_t step_rem = span % segments;
+	uint32_t offset = 0;
+	uint32_t error = 0;
+
+	for (size_t i = 0; i < points; ++i) {
+		ctx.sweep.ftw[i] = rising ? (ftw_start + offset) : (ftw_start - offset);
+
+		offset += step;
+		error += step_rem;
+		if (error >= segments) {
+			error -= segments;
+			++offset;
+		}
+	}
+}
+
+static void dds_sweep_fill_log(uint32_t ftw_start, uint32_t ftw_stop, uint16_t points)
+{
+	const uint32_t segments = points - 1;
+	const float ln_step = utils_logf((float)ftw_stop / ftw_start) / segments;
+
+	/* Compute each point from the start value to avoid accumulating rounding errors */
+	for (size_t i = 0; i < segments; ++i) {
+		ctx.sweep.ftw[i] = utils_roundf(ftw_start * utils_expf(ln_step * i));
+	}
+	ctx.sweep.ftw[segments] = ftw_stop;
+}
+
+static int dds_update_shadow_ftw(uint32_t ftw);
+
+static int dds_sweep_step(void)
+{
+	const int err = dds_update_shadow_ftw(ctx.sweep.ftw[ctx.sweep.index]);
 	if (err) {
 		return err;
 	}
 
+	switch (ctx.sweep.direction) {
+		case DDS_SWEEP_UP:
+			++ctx.sweep.index;
+			if (ctx.sweep.index >= ctx.sweep.points) {
+				ctx.sweep.index = 0;
+			}
+			break;
+		case DDS_SWEEP_DOWN:
+			--ctx.sweep.index;
+			if (ctx.sweep.index < 0) {
+				ctx.sweep.index = ctx.sweep.points - 1;
+			}
+			break;
+		case DDS_SWEEP_TRIANGLE:
+			if (ctx.sweep.index == 0) {
+				ctx.sweep.step = 1;
+			}
+			else if (ctx.sweep.index == (ctx.sweep.points - 1)) {
+				ctx.sweep.step = -1;
+			}
+			ctx.sweep.index += ctx.sweep.step;
+			break;
+		default:
+			break;
+	}
+
 	return 0;
 }
 
+static void dds_sweep_timer_init(uint16_t period_us)
+{
+	TIM_TimeBaseInitTypeDef tim_cfg = {0};
+	NVIC_InitTypeDef nvic_cfg = {0};
+
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
+
+	tim_cfg.TIM_Prescaler = (SystemCoreClock / DDS_SWEEP_TIMER_TICK_FREQ_HZ) - 1;
+	tim_cfg.TIM_CounterMode = TIM_CounterMode_Up;
+	tim_cfg.TIM_Period = period_us - 1;
+	tim_cfg.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseInit(DDS_SWEEP_TIMER, &tim_cfg);
+	TIM_ClearITPendingBit(DDS_SWEEP_TIMER, TIM_IT_Update);
+	TIM_ITConfig(DDS_SWEEP_TIMER, TIM_IT_Update, ENABLE);
+
+	nvic_cfg.NVIC_IRQChannel = TIM1_UP_IRQn;
+	nvic_cfg.NVIC_IRQChannelPreemptionPriority = 1;
+	nvic_cfg.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&nvic_cfg);
+
+	TIM_Cmd(DDS_SWEEP_TIMER, ENABLE);
+}
+
+static void dds_sweep_timer_deinit(void)
+{
+	TIM_Cmd(DDS_SWEEP_TIMER, DISABLE);
+	TIM_ITConfig(DDS_SWEEP_TIMER, TIM_IT_Update, DISABLE);
+	NVIC_DisableIRQ(TIM1_UP_IRQn);
+	TIM_ClearITPendingBit(DDS_SWEEP_TIMER, TIM_IT_Update);
+}
+
 static int dds_write_phase(uint16_t phase, dds_channel_t channel)
 {
 	uint16_t reg_val;
@@ -148,6 +328,240 @@ static int dds_write_phase(uint16_t phase, dds_channel_t channel)
 	return 0;
 }
 
+static int dds_write_pga(uint16_t pot_val)
+{
+	const uint16_t cmd = DDS_PGA_WRITE_CMD | DDS_PGA_POT_1_SELECT;
+
+	return pga_spi_write((cmd << 8) | pot_val);
+}
+
+static bool dds_write_mode_matches(uint16_t write_mode)
+{
+	if (!(ctx.written & DDS_REG_CTRL)) {
+		return false;
+	}
+
+	/* HLB is don't care in B28 mode */
+	if (write_mode == DDS_WRITE_MODE_FULL) {
+		return (ctx.hw_ctrl_reg & DDS_B28_CTRL_BIT) != 0;
+	}
+
+	return (ctx.hw_ctrl_reg & DDS_WRITE_MODE_MASK) == write_mode;
+}
+
+/* Changes only B28/HLB bits, the rest of the control word stays as the chip has it,
+ * so that e.g. FSELECT does not flip before the frequency register is complete. */
+static int dds_set_write_mode(uint16_t write_mode)
+{
+	if (dds_write_mode_matches(write_mode)) {
+		return 0;
+	}
+
+	const uint16_t reg_val = (ctx.hw_ctrl_reg & ~DDS_WRITE_MODE_MASK) | write_mode;
+	const int err = dds_spi_write(reg_val);
+	if (err) {
+		return err;
+	}
+
+	ctx.hw_ctrl_reg = reg_val;
+	ctx.written |= DDS_REG_CTRL;
+
+	return 0;
+}
+
+/* Control word to be written, keeping the write mode currently set in the chip */
+static uint16_t dds_get_ctrl_word(void)
+{
+	return (ctx.ctrl_reg & ~DDS_WRITE_MODE_MASK) | (ctx.hw_ctrl_reg & DDS_WRITE_MODE_MASK);
+}
+
+/* If only one 14-bit half of the tuning word changed, it can be written alone in HLB mode.
+ * Switching between B28 and HLB modes costs an extra control word, so the cheaper path is
+ * chosen each time - on a tie the half write wins, as the next fine step will be cheaper. */
+static int dds_flush_frequency(dds_channel_t channel)
+{
+	const uint32_t ftw = ctx.ftw[channel];
+	const uint32_t diff = ftw ^ ctx.hw_ftw[channel];
+	const bool known = (ctx.written & DDS_REG_FREQ(channel)) != 0;
+	const bool lsb_changed = (diff & DDS_FREQ_REG_WORD_MASK) != 0;
+	const bool msb_changed = (diff & (DDS_FREQ_REG_WORD_MASK << DDS_FREQ_REG_BITS_PER_WORD)) != 0;
+	int err;
+
+	if (known && !lsb_changed && !msb_changed) {
+		return 0;
+	}
+
+	if (known && (lsb_changed != msb_changed)) {
+		const uint16_t half_mode = msb_changed ? DDS_WRITE_MODE_MSB : DDS_WRITE_MODE_LSB;
+		const size_t full_cost = DDS_STREAM_FRAMES_PER_FTW + (dds_write_mode_matches(DDS_WRITE_MODE_FULL) ? 0 : 1);
+		const size_t half_cost = 1 + (dds_write_mode_matches(half_mode) ? 0 : 1);
+
+		if (half_cost <= full_cost) {
+			err = dds_set_write_mode(half_mode);
+			if (err) {
+				return err;
+			}
+
+			err = dds_write_frequency_half(ftw, msb_changed, channel);
+			if (err) {
+				return err;
+			}
+
+			ctx.hw_ftw[channel] = ftw;
+			return 0;
+		}
+	}
+
+	err = dds_set_write_mode(DDS_WRITE_MODE_FULL);
+	if (err) {
+		return err;
+	}
+
+	err = dds_write_frequency(ftw, channel);
+	if (err) {
+		return err;
+	}
+
+	ctx.hw_ftw[channel] = ftw;
+	ctx.written |= DDS_REG_FREQ(channel);
+
+	return 0;
+}
+
+static void dds_mark_dirty(uint8_t reg, bool changed)
+{
+	if (changed || !(ctx.written & reg)) {
+		ctx.dirty |= reg;
+	}
+}
+
+/* Writes every dirty register exactly once. Frequency and phase registers go first,
+ * so that a merged control word (e.g. FSELECT flip) switches to complete values. */
+static int dds_flush_registers(void)
+{
+	int err;
+
+	for (dds_channel_t ch = DDS_CH0; ch < DDS_CHANNEL_COUNT; ++ch) {
+		if (ctx.dirty & DDS_REG_FREQ(ch)) {
+			err = dds_flush_frequency(ch);
+			if (err) {
+				return err;
+			}
+			ctx.dirty &= ~DDS_REG_FREQ(ch);
+		}
+	}
+
+	for (dds_channel_t ch = DDS_CH0; ch < DDS_CHANNEL_COUNT; ++ch) {
+		if (ctx.dirty & DDS_REG_PHASE(ch)) {
+			err = dds_write_phase(ctx.phase_reg[ch], ch);
+			if (err) {
+				return err;
+			}
+			ctx.dirty &= ~DDS_REG_PHASE(ch);
+			ctx.written |= DDS_REG_PHASE(ch);
+		}
+	}
+
+	if (ctx.dirty & DDS_REG_CTRL) {
+		const uint16_t ctrl_word = dds_get_ctrl_word();
+		if ((ctrl_word != ctx.hw_ctrl_reg) || !(ctx.written & DDS_REG_CTRL)) {
+			err = dds_spi_write(ctrl_word);
+			if (err) {
+				return err;
+			}
+			ctx.hw_ctrl_reg = ctrl_word;
+			ctx.written |= DDS_REG_CTRL;
+		}
+		ctx.dirty &= ~DDS_REG_CTRL;
+	}
+
+	if (ctx.dirty & DDS_REG_PGA) {
+		err = dds_write_pga(ctx.pga_pot);
+		if (err) {
+			return err;
+		}
+		ctx.dirty &= ~DDS_REG_PGA;
+		ctx.written |= DDS_REG_PGA;
+	}
+
+	return 0;
+}
+
+static int dds_flush(void)
+{
+	/* Let SPI layer group PGA and DDS frames */
+	spi_batch_begin();
+	const int err = dds_flush_registers();
+	const int commit_err = spi_batch_commit();
+
+	return err ? err : commit_err;
+}
+
+/* Outside of a transaction changes are written right away */
+static int dds_sync(void)
+{
+	if (ctx.txn_depth > 0) {
+		return 0;
+	}
+
+	return dds_flush();
+}
+
+static int dds_update_ctrl_reg(void)
+{
+	dds_mark_dirty(DDS_REG_CTRL, dds_get_ctrl_word() != ctx.hw_ctrl_reg);
+
+	return dds_sync();
+}
+
+/* Sweep interrupt owns the shadow registers and SPI batch while running, setters must not touch them */
+static bool dds_is_busy(void)
+{
+	return ctx.sweep.running;
+}
+
+static int dds_update_frequency_channel(dds_channel_t channel)
+{
+	switch (channel) {
+		case DDS_CH0:
+			ctx.ctrl_reg &= ~DDS_FSELECT_CTRL_BIT;
+			break;
+		case DDS_CH1:
+			ctx.ctrl_reg |= DDS_FSELECT_CTRL_BIT;
+			break;
+		default:
+			break;
+	}
+
+	ctx.freq_ch = channel;
+
+	return dds_update_ctrl_reg();
+}
+
+static int dds_update_ftw(uint32_t ftw, dds_channel_t channel)
+{
+	dds_mark_dirty(DDS_REG_FREQ(channel), ctx.ftw[channel] != ftw);
+	ctx.ftw[channel] = ftw;
+
+	return dds_sync();
+}
+
+static int dds_update_shadow_ftw(uint32_t ftw)
+{
+	/* Nothing to do if the active register already holds this value */
+	if ((ftw == ctx.ftw[ctx.freq_ch]) && (ctx.written & DDS_REG_FREQ(ctx.freq_ch))) {
+		return 0;
+	}
+
+	const dds_channel_t inactive_ch = (ctx.freq_ch == DDS_CH0) ? DDS_CH1 : DDS_CH0;
+
+	const int err = dds_update_ftw(ftw, inactive_ch);
+	if (err) {
+		return err;
+	}
+
+	return dds_update_frequency_channel(inactive_ch);
+}
 
 int dds_init(void)
 {
@@ -166,15 +580,49 @@ int dds_init(void)
 	if (err) {
 		return err;
 	}
+	ctx.hw_ctrl_reg = ctx.ctrl_reg;
+	ctx.written = DDS_REG_CTRL;
+
+	return 0;
+}
+
+int dds_begin(void)
+{
+	if (dds_is_busy()) {
+		return -EBUSY;
+	}
+
+	++ctx.txn_depth;
 
 	return 0;
 }
 
+int dds_commit(void)
+{
+	if (ctx.txn_depth > 0) {
+		--ctx.txn_depth;
+	}
+
+	if (dds_is_busy()) {
+		return -EBUSY;
+	}
+
+	return dds_sync();
+}
+
+uint32_t dds_get_spi_frame_count(void)
+{
+	return ctx.spi_frames;
+}
+
 int dds_set_mode(dds_mode_t mode)
 {
 	if ((mode < 0) || (mode >= DDS_MODE_COUNT)) {
 		return -EINVAL;
 	}
+	if (dds_is_busy()) {
+		return -EBUSY;
+	}
 
 	/* Clear all mode bits in control register */
 	ctx.ctrl_reg &= ~(DDS_OPBITEN_CTRL_BIT | DDS_DIV2_CTRL_BIT | DDS_MODE_CTRL_BIT);
@@ -196,14 +644,9 @@ int dds_set_mode(dds_mode_t mode)
 			break;
 	}
 
-	const int err = dds_spi_write(ctx.ctrl_reg);
-	if (err) {
-		return err;
-	}
-
 	ctx.mode = mode;
 
-	return 0;
+	return dds_update_ctrl_reg();
 }
 
 dds_mode_t dds_get_mode(void)
@@ -216,26 +659,11 @@ int dds_set_frequency_channel(dds_channel_t channel)
 	if ((channel < 0) || (channel >= DDS_CHANNEL_COUNT)) {
 		return -EINVAL;
 	}
-
-	switch (channel) {
-		case DDS_CH0:
-			ctx.ctrl_reg &= ~DDS_FSELECT_CTRL_BIT;
-			break;
-		case DDS_CH1:
-			ctx.ctrl_reg |= DDS_FSELECT_CTRL_BIT;
-			break;
-		default:
-			break;
-	}
-
-	const int err = dds_spi_write(ctx.ctrl_reg);
-	if (err) {
-		return err;
+	if (dds_is_busy()) {
+		return -EBUSY;
 	}
 
-	ctx.freq_ch = channel;
-
-	return 0;
+	return dds_update_frequency_channel(channel);
 }
 
 dds_channel_t dds_get_frequency_channel(void)
@@ -245,21 +673,35 @@ dds_channel_t dds_get_frequency_channel(void)
 
 int dds_set_frequency(float frequency, dds_channel_t channel)
 {
-	if ((channel < 0) || (channel >= DDS_CHANNEL_COUNT)) {
-		return -EINVAL;
-	}
-
 	frequency = UTILS_CLAMP(frequency, 0.0f, DDS_MAX_OUTPUT_FREQ_HZ);
 
-	const uint32_t reg_val = utils_roundf(frequency * DDS_XTAL_FREQ_FACTOR);
-	const int err = dds_write_frequency(reg_val, channel);
-	if (err) {
-		return err;
-	}
+	return dds_set_frequency_mhz((uint64_t)(frequency * DDS_MILLIHZ_PER_HZ + 0.5f), channel);
+}
+
+int dds_set_frequency_hz(uint32_t frequency, dds_channel_t channel)
+{
+	frequency = UTILS_MIN(frequency, DDS_MAX_OUTPUT_FREQ_HZ);
 
-	ctx.freq[channel] = frequency;
+	return dds_set_ftw(dds_compute_ftw(frequency, DDS_XTAL_FREQ_HZ), channel);
+}
 
-	return 0;
+int dds_set_frequency_mhz(uint64_t frequency, dds_channel_t channel)
+{
+	frequency = UTILS_MIN(frequency, DDS_MAX_OUTPUT_FREQ_MHZ);
+
+	return dds_set_ftw(dds_compute_ftw(frequency, DDS_XTAL_FREQ_HZ * DDS_MILLIHZ_PER_HZ), channel);
+}
+
+int dds_set_ftw(uint32_t ftw, dds_channel_t channel)
+{
+	if ((channel < 0) || (channel >= DDS_CHANNEL_COUNT) || (ftw >= DDS_FREQ_REG_MAX_VALUE)) {
+		return -EINVAL;
+	}
+	if (dds_is_busy()) {
+		return -EBUSY;
+	}
+
+	return dds_update_ftw(ftw, channel);
 }
 
 float dds_get_frequency(dds_channel_t channel)
@@ -268,7 +710,35 @@ float dds_get_frequency(dds_channel_t channel)
 		return -1.0f;
 	}
 
-	return ctx.freq[channel];
+	return ctx.ftw[channel] / DDS_XTAL_FREQ_FACTOR;
+}
+
+uint32_t dds_get_ftw(dds_channel_t channel)
+{
+	if ((channel < 0) || (channel >= DDS_CHANNEL_COUNT)) {
+		return 0;
+	}
+
+	return ctx.ftw[channel];
+}
+
+int dds_shadow_set_frequency_hz(uint32_t frequency)
+{
+	frequency = UTILS_MIN(frequency, DDS_MAX_OUTPUT_FREQ_HZ);
+
+	return dds_shadow_set_ftw(dds_compute_ftw(frequency, DDS_XTAL_FREQ_HZ));
+}
+
+int dds_shadow_set_ftw(uint32_t ftw)
+{
+	if (ftw >= DDS_FREQ_REG_MAX_VALUE) {
+		return -EINVAL;
+	}
+	if (dds_is_busy()) {
+		return -EBUSY;
+	}
+
+	return dds_update_shadow_ftw(ftw);
 }
 
 int dds_set_phase_channel(dds_channel_t channel)
@@ -276,6 +746,9 @@ int dds_set_phase_channel(dds_channel_t channel)
 	if ((channel < DDS_CH0) || (channel > DDS_CH1)) {
 		return -EINVAL;
 	}
+	if (dds_is_busy()) {
+		return -EBUSY;
+	}
 
 	switch (channel) {
 		case DDS_CH0:
@@ -288,14 +761,9 @@ int dds_set_phase_channel(dds_channel_t channel)
 			break;
 	}
 
-	const int err = dds_spi_write(ctx.ctrl_reg);
-	if (err) {
-		return err;
-	}
-
 	ctx.phase_ch = channel;
 
-	return err;
+	return dds_update_ctrl_reg();
 }
 
 dds_channel_t dds_get_phase_channel(void)
@@ -308,19 +776,19 @@ int dds_set_phase(float phase, dds_channel_t channel)
 	if ((channel < 0) || (channel >= DDS_CHANNEL_COUNT)) {
 		return -EINVAL;
 	}
+	if (dds_is_busy()) {
+		return -EBUSY;
+	}
 
 	/* Normalize to <0; 360> */
 	phase = wrap_phase_degrees(phase);
 
-	const uint16_t reg_val = utils_roundf(phase * DDS_PHASE_FACTOR);
-	const int err = dds_write_phase(reg_val, channel);
-	if (err) {
-		return err;
-	}
-
+	const uint16_t reg_val = (uint16_t)utils_roundf(phase * DDS_PHASE_FACTOR) & DDS_PHASE_REG_VALUE_MASK;
+	dds_mark_dirty(DDS_REG_PHASE(channel), ctx.phase_reg[channel] != reg_val);
+	ctx.phase_reg[channel] = reg_val;
 	ctx.phase[channel] = phase;
 
-	return 0;
+	return dds_sync();
 }
 
 float dds_get_phase(dds_channel_t channel)
@@ -336,6 +804,10 @@ int dds_set_amplitude(float amplitude)
 {
 	float voltage_per_step;
 
+	if (dds_is_busy()) {
+		return -EBUSY;
+	}
+
 	if ((ctx.mode == DDS_MODE_SQUARE) || (ctx.mode == DDS_MODE_HALF_SQUARE)) {
 		amplitude = UTILS_CLAMP(amplitude, 0.0f, DDS_PGA_MAX_SQUARE_OUTPUT_AMPL_V);
 		voltage_per_step = DDS_PGA_SQUARE_VOLTAGE_PER_STEP_V;
@@ -346,16 +818,11 @@ int dds_set_amplitude(float amplitude)
 	}
 
 	const uint16_t pot_val = utils_roundf(amplitude / voltage_per_step);
-	const uint16_t cmd = DDS_PGA_WRITE_CMD | DDS_PGA_POT_1_SELECT;
-
-	const int err = pga_spi_write((cmd << 8) | pot_val);
-	if (err) {
-		return err;
-	}
-
+	dds_mark_dirty(DDS_REG_PGA, ctx.pga_pot != pot_val);
+	ctx.pga_pot = pot_val;
 	ctx.amplitude = pot_val * voltage_per_step;
 
-	return 0;
+	return dds_sync();
 }
 
 float dds_get_amplitude(void)
@@ -365,20 +832,17 @@ float dds_get_amplitude(void)
 
 int dds_set_output_enable(bool enable)
 {
-	int err;
+	/* Merge all control register changes into a single write */
+	const int err = dds_begin();
+	if (err) {
+		return err;
+	}
 
 	if (enable) {
 		ctx.ctrl_reg &= ~(DDS_SLEEP1_CTRL_BIT | DDS_SLEEP12_CTRL_BIT);
-		err = dds_spi_write(ctx.ctrl_reg);
-		if (err) {
-			return err;
-		}
 
 		/* Switch back to selected mode, setting proper OPBITEN value */
-		err = dds_set_mode(ctx.mode);
-		if (err) {
-			return err;
-		}
+		dds_set_mode(ctx.mode);
 	}
 	else {
 		/* If the sleep mode is entered in one of square wave modes, and MSB of DAC data
@@ -386,16 +850,150 @@ int dds_set_output_enable(bool enable)
 		 * by clearing OPBITEN mode to avoid that. */
 		ctx.ctrl_reg &= ~DDS_OPBITEN_CTRL_BIT;
 		ctx.ctrl_reg |= (DDS_SLEEP1_CTRL_BIT | DDS_SLEEP12_CTRL_BIT);
-		err = dds_spi_write(ctx.ctrl_reg);
-		if (err) {
-			return err;
-		}
+		dds_update_ctrl_reg();
 	}
 
-	return 0;
+	return dds_commit();
 }
 
 bool dds_get_output_enable(void)
 {
 	return (ctx.ctrl_reg & (DDS_SLEEP1_CTRL_BIT | DDS_SLEEP12_CTRL_BIT)) == 0;
 }
+
+int dds_sweep_start(const dds_sweep_config_t *config)
+{
+	if ((config == NULL) || (config->points < 2) || (config->points > DDS_SWEEP_MAX_POINTS) ||
+		(config->dwell_us < DDS_SWEEP_MIN_DWELL_US) || (config->scale < 0) || (config->scale >= DDS_SWEEP_SCALE_COUNT) ||
+		(config->direction < 0) || (config->direction >= DDS_SWEEP_DIRECTION_COUNT)) {
+		return -EINVAL;
+	}
+
+	/* Changes staged in an open transaction would be flushed from the sweep interrupt */
+	if (ctx.sweep.running || spi_stream_is_running() || (ctx.txn_depth > 0)) {
+		return -EBUSY;
+	}
+
+	const uint32_t ftw_start = dds_compute_ftw(UTILS_MIN(config->start_freq, DDS_MAX_OUTPUT_FREQ_HZ), DDS_XTAL_FREQ_HZ);
+	const uint32_t ftw_stop = dds_compute_ftw(UTILS_MIN(config->stop_freq, DDS_MAX_OUTPUT_FREQ_HZ), DDS_XTAL_FREQ_HZ);
+
+	switch (config->scale) {
+		case DDS_SWEEP_LINEAR:
+			dds_sweep_fill_linear(ftw_start, ftw_stop, config->points);
+			break;
+		case DDS_SWEEP_LOG:
+			/* Logarithmic sweep is undefined for 0Hz */
+			if ((ftw_start == 0) || (ftw_stop == 0)) {
+				return -EINVAL;
+			}
+			dds_sweep_fill_log(ftw_start, ftw_stop, config->points);
+			break;
+		default:
+			break;
+	}
+
+	ctx.sweep.points = config->points;
+	ctx.sweep.direction = config->direction;
+	ctx.sweep.index = (config->direction == DDS_SWEEP_DOWN) ? (config->points - 1) : 0;
+	ctx.sweep.step = 1;
+
+	/* Output the first point right away, the timer takes over from the next one */
+	const int err = dds_sweep_step();
+	if (err) {
+		return err;
+	}
+
+	ctx.sweep.running = true;
+	dds_sweep_timer_init(config->dwell_us);
+
+	return 0;
+}
+
+int dds_sweep_stop(void)
+{
+	if (!ctx.sweep.running) {
+		return 0;
+	}
+
+	dds_sweep_timer_deinit();
+	ctx.sweep.running = false;
+
+	return 0;
+}
+
+bool dds_sweep_is_running(void)
+{
+	return ctx.sweep.running;
+}
+
+int dds_stream_start(const uint16_t *frames, size_t count, uint32_t rate_hz, bool loop)
+{
+	/* Sweep and stream share TIM1 */
+	if (ctx.sweep.running || spi_stream_is_running()) {
+		return -EBUSY;
+	}
+
+	/* Frames are packed for B28 mode */
+	int err = dds_set_write_mode(DDS_WRITE_MODE_FULL);
+	if (err) {
+		return err;
+	}
+
+	/* Let queued frames go out before taking over the bus */
+	err = spi_queue_flush();
+	if (err) {
+		return err;
+	}
+
+	spi_select(&dds_spi_device);
+
+	err = spi_stream_start(frames, count, rate_hz, loop);
+	if (err) {
+		spi_deselect(&dds_spi_device);
+		return err;
+	}
+
+	return 0;
+}
+
+int dds_stream_stop(void)
+{
+	spi_stream_stop();
+	spi_deselect(&dds_spi_device);
+
+	/* Streamed frames bypass the shadow registers, chip contents are unknown now */
+	ctx.written &= DDS_REG_PGA;
+
+	return 0;
+}
+
+bool dds_stream_is_running(void)
+{
+	return spi_stream_is_running();
+}
+
+size_t dds_stream_pack_ftw(uint16_t *frames, uint32_t ftw, dds_channel_t channel)
+{
+	if ((frames == NULL) || (ftw >= DDS_FREQ_REG_MAX_VALUE)) {
+		return 0;
+	}
+
+	if (dds_pack_frequency(frames, ftw, channel)) {
+		return 0;
+	}
+
+	return DDS_STREAM_FRAMES_PER_FTW;
+}
+
+void TIM1_UP_IRQHandler(void)
+{
+	if (TIM_GetITStatus(DDS_SWEEP_TIMER, TIM_IT_Update) != RESET) {
+		TIM_ClearITPendingBit(DDS_SWEEP_TIMER, TIM_IT_Update);
+
+		/* Give up on SPI failure rather than keep hammering the bus from interrupt context */
+		if (dds_sweep_step()) {
+			dds_sweep_timer_deinit();
+			ctx.sweep.running = false;
+		}
+	}
+}
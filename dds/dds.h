@@ -1,9 +1,13 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 
 #define DDS_XTAL_FREQ_HZ 25000000U
 #define DDS_MAX_OUTPUT_FREQ_HZ (DDS_XTAL_FREQ_HZ / 2)
+#define DDS_MILLIHZ_PER_HZ 1000ULL
+#define DDS_MAX_OUTPUT_FREQ_MHZ (DDS_MAX_OUTPUT_FREQ_HZ * DDS_MILLIHZ_PER_HZ) // Milli-Hz, not MHz
 #define DDS_MAX_PHASE_DEG 360.0f
 #define DDS_PHASE_REG_BITS 12
 #define DDS_PHASE_REG_MAX_VALUE (1U << DDS_PHASE_REG_BITS)
@@ -27,6 +31,12 @@
 #define DDS_PGA_MAX_SQUARE_OUTPUT_AMPL_V DDS_MAX_SQUARE_OUTPUT_AMPL_V // In theory should be multiplied by DDS_PGA_OUTPUT_STAGE_GAIN, but power supply is the limitation
 #define DDS_PGA_MAX_OUTPUT_AMPL_V (DDS_MAX_OUTPUT_AMPL_V * DDS_PGA_GAIN)
 
+/* Sweep points are precomputed into a RAM table of tuning words, each timer tick only costs SPI frames */
+#define DDS_SWEEP_MAX_POINTS 64
+#define DDS_SWEEP_MIN_DWELL_US 10
+
+#define DDS_STREAM_FRAMES_PER_FTW 2
+
 #define DDS_PGA_STEPS_NUM 256
 #define DDS_PGA_SQUARE_VOLTAGE_PER_STEP_V ((DDS_MAX_SQUARE_OUTPUT_AMPL_V * DDS_PGA_GAIN) / DDS_PGA_STEPS_NUM)
 #define DDS_PGA_VOLTAGE_PER_STEP_V ((DDS_MAX_OUTPUT_AMPL_V * DDS_PGA_GAIN) / DDS_PGA_STEPS_NUM)
@@ -40,6 +50,31 @@ typedef enum
 	DDS_MODE_COUNT
 } dds_mode_t;
 
+typedef enum
+{
+	DDS_SWEEP_LINEAR,
+	DDS_SWEEP_LOG,
+	DDS_SWEEP_SCALE_COUNT
+} dds_sweep_scale_t;
+
+typedef enum
+{
+	DDS_SWEEP_UP,
+	DDS_SWEEP_DOWN,
+	DDS_SWEEP_TRIANGLE,
+	DDS_SWEEP_DIRECTION_COUNT
+} dds_sweep_direction_t;
+
+typedef struct
+{
+	uint32_t start_freq; // Hz
+	uint32_t stop_freq; // Hz
+	uint16_t points;
+	uint16_t dwell_us;
+	dds_sweep_scale_t scale;
+	dds_sweep_direction_t direction;
+} dds_sweep_config_t;
+
 typedef enum
 {
 	DDS_CH0 = 0,
@@ -49,14 +84,31 @@ typedef enum
 
 int dds_init(void);
 
+/* Transactions - setters called between dds_begin() and dds_commit() only update shadow registers,
+ * commit writes each changed register once. Transactions can be nested, outermost commit writes. */
+int dds_begin(void);
+int dds_commit(void);
+
+uint32_t dds_get_spi_frame_count(void);
+
 int dds_set_mode(dds_mode_t mode);
 dds_mode_t dds_get_mode(void);
 
 int dds_set_frequency_channel(dds_channel_t channel);
 dds_channel_t dds_get_frequency_channel(void);
 
+/* Float entry point kept for convenience, prefer integer variants - the core has no FPU */
 int dds_set_frequency(float frequency, dds_channel_t channel);
+int dds_set_frequency_hz(uint32_t frequency, dds_channel_t channel);
+int dds_set_frequency_mhz(uint64_t frequency, dds_channel_t channel); // Frequency in milli-Hz
+int dds_set_ftw(uint32_t ftw, dds_channel_t channel);
 float dds_get_frequency(dds_channel_t channel);
+uint32_t dds_get_ftw(dds_channel_t channel);
+
+/* Shadow bank retuning - the new tuning word goes to the inactive frequency register, then FSELECT
+ * is flipped with a single control word write, so the output never sees a half-updated word */
+int dds_shadow_set_frequency_hz(uint32_t frequency);
+int dds_shadow_set_ftw(uint32_t ftw);
 
 int dds_set_phase_channel(dds_channel_t channel);
 dds_channel_t dds_get_phase_channel(void);
@@ -69,3 +121,21 @@ float dds_get_amplitude(void);
 
 int dds_set_output_enable(bool enable);
 bool dds_get_output_enable(void);
+
+/* Hardware-timed sweep driven from TIM1 update interrupt. While the sweep is running dds_begin() and
+ * all dds_set_* functions return -EBUSY, stop it first. */
+int dds_sweep_start(const dds_sweep_config_t *config);
+int dds_sweep_stop(void);
+bool dds_sweep_is_running(void);
+
+/* Zero CPU load streaming of precomputed AD9833 frames, paced by timer and moved by DMA.
+ * FSYNC is held low for the whole stream, the chip accepts back-to-back 16-bit words this way.
+ * Call dds_stream_stop() to release the bus, also after a one-shot stream completes.
+ * Frames assume 28-bit (B28) frequency write mode. With SPI clock at SystemCoreClock / 2 a frame
+ * takes 32 core cycles, rate_hz above SystemCoreClock / 64 (125 kHz at the default 8 MHz) gives -EINVAL. */
+int dds_stream_start(const uint16_t *frames, size_t count, uint32_t rate_hz, bool loop);
+int dds_stream_stop(void);
+bool dds_stream_is_running(void);
+size_t dds_stream_pack_ftw(uint16_t *frames, uint32_t ftw, dds_channel_t channel);
+
+void TIM1_UP_IRQHandler(void) __attribute__((interrupt));
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dds.h"
+
+/* Computes round(frequency * 2^28 / xtal_frequency) using shift-and-subtract long division.
+ * RV32EC has neither FPU nor hardware multiplier/divider, so this keeps the whole conversion
+ * in a fixed 28 iterations of shifts, compares and subtractions, without any libgcc calls.
+ * Both arguments must be in the same unit, frequency has to be lower than xtal_frequency.
+ * Kept free of hardware dependencies, so that tests/ can build it for the host. */
+inline static uint32_t dds_compute_ftw(uint64_t frequency, uint64_t xtal_frequency)
+{
+	uint64_t remainder = frequency;
+	uint32_t ftw = 0;
+
+	for (size_t i = 0; i < DDS_FREQ_REG_BITS; ++i) {
+		remainder <<= 1;
+		ftw <<= 1;
+		if (remainder >= xtal_frequency) {
+			remainder -= xtal_frequency;
+			ftw |= 1;
+		}
+	}
+
+	/* Round half up */
+	if ((remainder << 1) >= xtal_frequency) {
+		++ftw;
+	}
+
+	return ftw;
+}
@@ -10,19 +10,32 @@
 #define SYSTICK_SR_CNTIF_BIT (1 << 0)
 
 #define SYSTICK_IRQ_FREQ_HZ 1000
+#define SYSTICK_US_PER_S 1000000
+#define SYSTICK_US_PER_TICK (SYSTICK_US_PER_S / SYSTICK_IRQ_FREQ_HZ)
+
+/* Timestamp layout - ticks in the upper half, counter in the lower, period must fit in 16 bits,
+ * which holds up to 65MHz core clock */
+#define DELAY_TIMESTAMP_TICKS_SHIFT 16
+#define DELAY_TIMESTAMP_CYCLES_MASK 0xFFFF
 
 typedef struct
 {
     volatile uint32_t ticks;
+    uint32_t cycles_per_us;
+    uint32_t period; // SysTick counts from 0 to CMP, then reloads
 } delay_ctx_t;
 
 static delay_ctx_t ctx;
 
 void delay_init(void)
 {
+    /* Calibrate to current core clock, SysTick is clocked from HCLK */
+    ctx.cycles_per_us = SystemCoreClock / SYSTICK_US_PER_S;
+    ctx.period = SystemCoreClock / SYSTICK_IRQ_FREQ_HZ;
+
     /* Set SysTick to generate interrupt every 1ms */
     SysTick->CNT = 0; // Clear counter
-    SysTick->CMP = (SystemCoreClock / SYSTICK_IRQ_FREQ_HZ) - 1;
+    SysTick->CMP = ctx.period - 1;
     SysTick->CTLR = SYSTICK_CTRL_STE_BIT | SYSTICK_CTRL_STIE_BIT |
                     SYSTICK_CTRL_STCLK_BIT | SYSTICK_CTRL_STRE_BIT; // Start Systick, enable interrupt, clock = HCLK, enable auto-reload
 
@@ -39,11 +52,73 @@ void delay_ms(uint32_t ms)
     }
 }
 
+void delay_us(uint32_t us)
+{
+    uint32_t remaining = us * ctx.cycles_per_us;
+    uint32_t last = SysTick->CNT;
+
+    /* Accumulate elapsed cycles, counter wraps to 0 every period */
+    while (remaining > 0) {
+        const uint32_t now = SysTick->CNT;
+        const uint32_t elapsed = (now >= last) ? (now - last) : (ctx.period - last + now);
+
+        if (elapsed >= remaining) {
+            break;
+        }
+        remaining -= elapsed;
+        last = now;
+    }
+}
+
 uint32_t delay_get_ticks(void)
 {
     return ctx.ticks;
 }
 
+uint32_t delay_get_us(void)
+{
+    uint32_t ticks;
+    uint32_t cycles;
+
+    /* Retry if tick interrupt came in between the reads */
+    do {
+        ticks = ctx.ticks;
+        cycles = SysTick->CNT;
+    } while (ticks != ctx.ticks);
+
+    return (ticks * SYSTICK_US_PER_TICK) + (cycles / ctx.cycles_per_us);
+}
+
+uint32_t delay_get_timestamp(void)
+{
+    uint32_t ticks;
+    uint32_t cycles;
+
+    /* Retry if tick interrupt came in between the reads */
+    do {
+        ticks = ctx.ticks;
+        cycles = SysTick->CNT;
+    } while (ticks != ctx.ticks);
+
+    return (ticks << DELAY_TIMESTAMP_TICKS_SHIFT) | cycles;
+}
+
+uint32_t delay_get_elapsed_us(uint32_t timestamp)
+{
+    const uint32_t now = delay_get_timestamp();
+    uint16_t ticks = (now >> DELAY_TIMESTAMP_TICKS_SHIFT) - (timestamp >> DELAY_TIMESTAMP_TICKS_SHIFT);
+    uint32_t cycles = now & DELAY_TIMESTAMP_CYCLES_MASK;
+    const uint32_t start_cycles = timestamp & DELAY_TIMESTAMP_CYCLES_MASK;
+
+    /* Borrow one tick if the counter wrapped */
+    if (cycles < start_cycles) {
+        --ticks;
+        cycles += ctx.period;
+    }
+
+    return (ticks * SYSTICK_US_PER_TICK) + ((cycles - start_cycles) / ctx.cycles_per_us);
+}
+
 void delay_suspend_tick(void)
 {
     SysTick->CTLR &= ~SYSTICK_CTRL_STE_BIT;
@@ -5,8 +5,19 @@
 void delay_init(void);
 
 void delay_ms(uint32_t ms);
+
+/* Busy-waits counting SysTick cycles, SysTick must be running */
+void delay_us(uint32_t us);
 uint32_t delay_get_ticks(void);
 
+/* Microseconds since delay_init(), wraps after ~71 minutes. Divides, keep it out of interrupts. */
+uint32_t delay_get_us(void);
+
+/* Raw timestamp cheap enough for interrupts - tick count and SysTick counter packed together,
+ * no arithmetic on RV32EC libgcc. Convert it later with delay_get_elapsed_us(), at most ~65s back. */
+uint32_t delay_get_timestamp(void);
+uint32_t delay_get_elapsed_us(uint32_t timestamp);
+
 void delay_suspend_tick(void);
 void delay_resume_tick(void);
 
@@ -50,6 +50,13 @@
 /* Global variable used to store variable value in read sequence */
 static uint16_t DataVar = 0;
 
+/* RAM copy of the latest value of each variable, indexed like VirtAddVarTab */
+static uint16_t EE_IndexData[NB_OF_VAR];
+/* Bit n set if variable n was found in Flash or written since */
+static uint32_t EE_IndexFound = 0;
+/* Index is only used after EE_Init() has built it */
+static uint8_t EE_IndexReady = 0;
+
 /* Virtual address defined by the user: 0xFFFF value is prohibited */
 extern uint16_t VirtAddVarTab[NB_OF_VAR];
 
@@ -60,6 +67,10 @@ static uint16_t EE_FindValidPage(uint8_t Operation);
 static uint16_t EE_VerifyPageFullWriteVariable(uint16_t VirtAddress, uint16_t Data);
 static uint16_t EE_PageTransfer(uint16_t VirtAddress, uint16_t Data);
 static uint16_t EE_VerifyPageFullyErased(uint32_t Address);
+static uint16_t EE_ReadVariableFlash(uint16_t VirtAddress, uint16_t* Data);
+static int16_t EE_FindVarIndex(uint16_t VirtAddress);
+static uint16_t EE_BuildIndex(void);
+static void EE_UpdateIndex(uint16_t VirtAddress, uint16_t Data);
 
 /**
   * @brief  Restore the pages to a known good state in case of page's status
@@ -76,6 +87,9 @@ uint16_t EE_Init(void)
   int16_t x = -1;
   FLASH_Status flashstatus;
 
+  /* Repair below has to read Flash directly */
+  EE_IndexReady = 0;
+
   /* Get Page0 status */
   pagestatus0 = (*(__IO uint16_t*)PAGE0_BASE_ADDRESS);
   /* Get Page1 status */
@@ -133,7 +147,7 @@ uint16_t EE_Init(void)
           if (varidx != x)
           {
             /* Read the last variables' updates */
-            readstatus = EE_ReadVariable(VirtAddVarTab[varidx], &DataVar);
+            readstatus = EE_ReadVariableFlash(VirtAddVarTab[varidx], &DataVar);
             /* In case variable corresponding to the virtual address was found */
             if (readstatus != 0x1)
             {
@@ -219,7 +233,7 @@ uint16_t EE_Init(void)
           if (varidx != x)
           {
             /* Read the last variables' updates */
-            readstatus = EE_ReadVariable(VirtAddVarTab[varidx], &DataVar);
+            readstatus = EE_ReadVariableFlash(VirtAddVarTab[varidx], &DataVar);
             /* In case variable corresponding to the virtual address was found */
             if (readstatus != 0x1)
             {
@@ -260,7 +274,8 @@ uint16_t EE_Init(void)
       break;
   }
 
-  return FLASH_COMPLETE;
+  /* Pages are in a known good state now, cache their content */
+  return EE_BuildIndex();
 }
 
 /**
@@ -302,7 +317,8 @@ uint16_t EE_VerifyPageFullyErased(uint32_t Address)
 
 /**
   * @brief  Returns the last stored variable data, if found, which correspond to
-  *   the passed virtual address
+  *   the passed virtual address. Served from RAM index without Flash access
+  *   once EE_Init() succeeded.
   * @param  VirtAddress: Variable virtual address
   * @param  Data: Global variable contains the read variable value
   * @retval Success or error status:
@@ -311,6 +327,37 @@ uint16_t EE_VerifyPageFullyErased(uint32_t Address)
   *           - NO_VALID_PAGE: if no valid page was found.
   */
 uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t* Data)
+{
+  int16_t varidx = -1;
+
+  /* Index not built yet, search Flash */
+  if (!EE_IndexReady)
+  {
+    return EE_ReadVariableFlash(VirtAddress, Data);
+  }
+
+  varidx = EE_FindVarIndex(VirtAddress);
+  if ((varidx < 0) || !(EE_IndexFound & (1UL << varidx)))
+  {
+    return 1;
+  }
+
+  *Data = EE_IndexData[varidx];
+
+  return 0;
+}
+
+/**
+  * @brief  Returns the last stored variable data by scanning the active page
+  *   from its end
+  * @param  VirtAddress: Variable virtual address
+  * @param  Data: Global variable contains the read variable value
+  * @retval Success or error status:
+  *           - 0: if variable was found
+  *           - 1: if the variable was not found
+  *           - NO_VALID_PAGE: if no valid page was found.
+  */
+static uint16_t EE_ReadVariableFlash(uint16_t VirtAddress, uint16_t* Data)
 {
   uint16_t validpage = PAGE0;
   uint16_t addressvalue = 0x5555, readstatus = 1;
@@ -383,10 +430,99 @@ uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data)
     Status = EE_PageTransfer(VirtAddress, Data);
   }
 
+  /* Page transfer copies the other variables unchanged, only this one needs an update */
+  if (Status == FLASH_COMPLETE)
+  {
+    EE_UpdateIndex(VirtAddress, Data);
+  }
+
   /* Return last operation status */
   return Status;
 }
 
+/**
+  * @brief  Finds position of the virtual address in VirtAddVarTab
+  * @param  VirtAddress: Variable virtual address
+  * @retval Index of the variable or -1 if the address is not in the table
+  */
+static int16_t EE_FindVarIndex(uint16_t VirtAddress)
+{
+  uint16_t varidx = 0;
+
+  /* Fast path for the usual table filled with consecutive addresses */
+  if ((VirtAddress < NB_OF_VAR) && (VirtAddVarTab[VirtAddress] == VirtAddress))
+  {
+    return VirtAddress;
+  }
+
+  for (varidx = 0; varidx < NB_OF_VAR; varidx++)
+  {
+    if (VirtAddVarTab[varidx] == VirtAddress)
+    {
+      return varidx;
+    }
+  }
+
+  return -1;
+}
+
+/**
+  * @brief  Stores the value of written variable in RAM index
+  * @param  VirtAddress: Variable virtual address
+  * @param  Data: 16 bit data written as variable value
+  * @retval None
+  */
+static void EE_UpdateIndex(uint16_t VirtAddress, uint16_t Data)
+{
+  int16_t varidx = EE_FindVarIndex(VirtAddress);
+
+  if (varidx < 0)
+  {
+    return;
+  }
+
+  EE_IndexData[varidx] = Data;
+  EE_IndexFound |= (1UL << varidx);
+}
+
+/**
+  * @brief  Fills RAM index with the latest values from the active page,
+  *   scanning it once from the beginning so later records override earlier ones
+  * @param  None
+  * @retval Success or error status:
+  *           - FLASH_COMPLETE: on success
+  *           - NO_VALID_PAGE: if no valid page was found
+  */
+static uint16_t EE_BuildIndex(void)
+{
+  uint16_t validpage = PAGE0;
+  uint32_t address = EEPROM_START_ADDRESS, pageendaddress = EEPROM_START_ADDRESS + PAGE_SIZE;
+
+  EE_IndexReady = 0;
+  EE_IndexFound = 0;
+
+  validpage = EE_FindValidPage(READ_FROM_VALID_PAGE);
+  if (validpage == NO_VALID_PAGE)
+  {
+    return NO_VALID_PAGE;
+  }
+
+  /* First record follows the page header */
+  address = (uint32_t)(EEPROM_START_ADDRESS + (uint32_t)(validpage * PAGE_SIZE)) + 4;
+  pageendaddress = (uint32_t)(EEPROM_START_ADDRESS + (uint32_t)((validpage + 1) * PAGE_SIZE));
+
+  /* Records are programmed in order, the first erased one ends the log */
+  while ((address < pageendaddress) && ((*(__IO uint32_t*)address) != 0xFFFFFFFF))
+  {
+    EE_UpdateIndex((*(__IO uint16_t*)(address + 2)), (*(__IO uint16_t*)address));
+    address = address + 4;
+  }
+
+  EE_IndexReady = 1;
+
+  return FLASH_COMPLETE;
+}
+
 /**
   * @brief  Erases PAGE and PAGE1 and writes VALID_PAGE header to PAGE
   * @param  None
@@ -87,7 +87,7 @@
 /* Page full define */
 #define PAGE_FULL             ((uint8_t)0x80)
 
-/* Variables' number */
+/* Variables' number, at most 32 - RAM index keeps a found-bit per variable in uint32_t */
 #define NB_OF_VAR             ((uint8_t)6)
 
 /* Exported types ------------------------------------------------------------*/
@@ -0,0 +1,339 @@
+#include "flash_log.h"
+#include <utils.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#define FLASH_LOG_SLOT_SIZE 64 // Fast programming unit
+#define FLASH_LOG_SLOT_WORDS (FLASH_LOG_SLOT_SIZE / sizeof(uint32_t))
+#define FLASH_LOG_SLOTS_PER_SECTOR (FLASH_LOG_SECTOR_SIZE / FLASH_LOG_SLOT_SIZE)
+#define FLASH_LOG_CRC_OFFSET (FLASH_LOG_SLOT_SIZE - sizeof(uint32_t))
+#define FLASH_LOG_NO_SLOT UINT16_MAX
+#define FLASH_LOG_ERASED_WORD 0xFFFFFFFF
+
+#define FLASH_LOG_SLOT_ADDRESS(slot) (FLASH_LOG_START_ADDRESS + ((uint32_t)(slot) * FLASH_LOG_SLOT_SIZE))
+#define FLASH_LOG_SECTOR_ADDRESS(sector) (FLASH_LOG_START_ADDRESS + ((uint32_t)(sector) * FLASH_LOG_SECTOR_SIZE))
+#define FLASH_LOG_FIRST_SLOT(sector) ((uint16_t)((sector) * FLASH_LOG_SLOTS_PER_SECTOR))
+#define FLASH_LOG_NEXT_SECTOR(sector) ((uint8_t)(((sector) + 1) % FLASH_LOG_SECTORS_NUM))
+
+/* Written at the start of every slot, followed by data and CRC in the last word */
+typedef struct
+{
+    uint32_t sequence; // Sector sequence number, same for all slots of a sector
+    uint32_t erase_count; // Sector erase count when the slot was written
+    uint16_t key;
+    uint16_t size;
+} flash_log_header_t;
+
+typedef struct
+{
+    uint16_t key_slot[FLASH_LOG_KEYS_NUM]; // Slot with the latest record of each key
+    uint32_t sector_sequence[FLASH_LOG_SECTORS_NUM]; // Zero if sector holds no record
+    uint32_t erase_count[FLASH_LOG_SECTORS_NUM];
+    uint32_t next_sequence;
+    uint8_t head; // Sector being written
+    uint8_t head_slot; // Next free slot within head sector
+    bool ready;
+} flash_log_ctx_t;
+
+static flash_log_ctx_t ctx;
+
+/* Image end from linker script, region must not overlap it */
+extern uint32_t _data_lma;
+extern uint32_t _data_vma;
+extern uint32_t _edata;
+
+static_assert(FLASH_LOG_SECTOR_SIZE >= FLASH_LOG_SLOT_SIZE, "Sector has to hold at least one slot");
+static_assert(sizeof(flash_log_header_t) + FLASH_LOG_DATA_MAX_SIZE + sizeof(uint32_t) == FLASH_LOG_SLOT_SIZE, "Slot layout mismatch");
+static_assert(FLASH_LOG_KEYS_NUM < ((FLASH_LOG_SECTORS_NUM - 1) * FLASH_LOG_SLOTS_PER_SECTOR), "Too many keys for garbage collection to always free a slot, add sectors");
+
+static const flash_log_header_t *flash_log_slot_header(uint16_t slot)
+{
+    return (const flash_log_header_t *)FLASH_LOG_SLOT_ADDRESS(slot);
+}
+
+static uint32_t flash_log_crc(const flash_log_header_t *header, const void *data, size_t size)
+{
+    const uint32_t crc = utils_crc32_update(UTILS_CRC32_INIT, header, sizeof(*header));
+
+    return ~utils_crc32_update(crc, data, size);
+}
+
+static bool flash_log_is_erased(uint32_t address, size_t size)
+{
+    const uint32_t *words = (const uint32_t *)address;
+
+    for (size_t i = 0; i < (size / sizeof(uint32_t)); ++i) {
+        if (words[i] != FLASH_LOG_ERASED_WORD) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool flash_log_slot_is_valid(uint16_t slot)
+{
+    const flash_log_header_t *header = flash_log_slot_header(slot);
+    const uint32_t crc = *(const uint32_t *)(FLASH_LOG_SLOT_ADDRESS(slot) + FLASH_LOG_CRC_OFFSET);
+
+    if ((header->key >= FLASH_LOG_KEYS_NUM) || (header->size > FLASH_LOG_DATA_MAX_SIZE)) {
+        return false;
+    }
+
+    return (crc == flash_log_crc(header, header + 1, header->size));
+}
+
+/* Slots are ordered by sector sequence, then by position within sector */
+static bool flash_log_slot_is_newer(uint16_t slot, uint16_t than)
+{
+    const uint32_t sequence = flash_log_slot_header(slot)->sequence;
+    const uint32_t than_sequence = flash_log_slot_header(than)->sequence;
+
+    return (sequence > than_sequence) || ((sequence == than_sequence) && (slot > than));
+}
+
+/* Blank sector is left alone, so only erases that really happen wear it and show in its count */
+static int flash_log_erase_sector(uint8_t sector)
+{
+    const uint32_t address = FLASH_LOG_SECTOR_ADDRESS(sector);
+
+    ctx.sector_sequence[sector] = 0;
+    if (flash_log_is_erased(address, FLASH_LOG_SECTOR_SIZE)) {
+        return 0;
+    }
+
+#if FLASH_LOG_1K_SECTORS
+    FLASH_ErasePage(address);
+#else
+    FLASH_ErasePage_Fast(address);
+#endif
+    ++ctx.erase_count[sector];
+
+    if (!flash_log_is_erased(address, FLASH_LOG_SECTOR_SIZE)) {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+static int flash_log_program(uint16_t key, const void *data, size_t size)
+{
+    if (ctx.head_slot >= FLASH_LOG_SLOTS_PER_SECTOR) {
+        return -ENOSPC;
+    }
+
+    /* Sector gets its sequence number with the first record, empty sectors need none */
+    if (ctx.sector_sequence[ctx.head] == 0) {
+        ctx.sector_sequence[ctx.head] = ctx.next_sequence++;
+    }
+
+    const uint16_t slot = FLASH_LOG_FIRST_SLOT(ctx.head) + ctx.head_slot;
+    const uint32_t address = FLASH_LOG_SLOT_ADDRESS(slot);
+    const flash_log_header_t header = {
+        .sequence = ctx.sector_sequence[ctx.head],
+        .erase_count = ctx.erase_count[ctx.head],
+        .key = key,
+        .size = size
+    };
+    const uint32_t *header_words = (const uint32_t *)&header;
+    const uint8_t *bytes = data;
+
+    /* Slot is used even if programming fails, it is not erased anymore */
+    ++ctx.head_slot;
+
+    /* Words that are not loaded stay erased */
+    FLASH_BufReset();
+    for (size_t i = 0; i < (sizeof(header) / sizeof(uint32_t)); ++i) {
+        FLASH_BufLoad(address + (i * sizeof(uint32_t)), header_words[i]);
+    }
+    for (size_t offset = 0; offset < size; offset += sizeof(uint32_t)) {
+        uint32_t word = FLASH_LOG_ERASED_WORD;
+        memcpy(&word, &bytes[offset], UTILS_MIN(sizeof(word), size - offset));
+        FLASH_BufLoad(address + sizeof(header) + offset, word);
+    }
+    FLASH_BufLoad(address + FLASH_LOG_CRC_OFFSET, flash_log_crc(&header, data, size));
+    FLASH_ProgramPage_Fast(address);
+
+    if (!flash_log_slot_is_valid(slot)) {
+        return -EIO;
+    }
+
+    ctx.key_slot[key] = slot;
+
+    return 0;
+}
+
+/* Moves live records out of the sector and erases it. Copies are made first,
+ * so after a power loss every record is still in at least one place. */
+static int flash_log_collect(uint8_t sector)
+{
+    const uint16_t first_slot = FLASH_LOG_FIRST_SLOT(sector);
+
+    for (uint16_t key = 0; key < FLASH_LOG_KEYS_NUM; ++key) {
+        const uint16_t slot = ctx.key_slot[key];
+
+        if ((slot == FLASH_LOG_NO_SLOT) || (slot < first_slot) || (slot >= (first_slot + FLASH_LOG_SLOTS_PER_SECTOR))) {
+            continue;
+        }
+
+        const flash_log_header_t *header = flash_log_slot_header(slot);
+        const int err = flash_log_program(key, header + 1, header->size);
+        if (err) {
+            return err;
+        }
+    }
+
+    return flash_log_erase_sector(sector);
+}
+
+/* Opens the erased sector after head and frees the oldest one to keep the next one erased */
+static int flash_log_advance(void)
+{
+    ctx.head = FLASH_LOG_NEXT_SECTOR(ctx.head);
+    ctx.head_slot = 0;
+
+    return flash_log_collect(FLASH_LOG_NEXT_SECTOR(ctx.head));
+}
+
+static int flash_log_format(void)
+{
+    for (uint8_t sector = 0; sector < FLASH_LOG_SECTORS_NUM; ++sector) {
+        const int err = flash_log_erase_sector(sector);
+        if (err) {
+            return err;
+        }
+    }
+
+    ctx.head = 0;
+    ctx.head_slot = 0;
+    ctx.next_sequence = 1;
+
+    return 0;
+}
+
+int flash_log_init(void)
+{
+    const uint32_t image_end = (uint32_t)&_data_lma + ((uint32_t)&_edata - (uint32_t)&_data_vma);
+    uint32_t max_erase_count = 0;
+    uint32_t head_sequence = 0;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(ctx.key_slot, 0xFF, sizeof(ctx.key_slot));
+
+    /* Code is linked at alias address 0 */
+    if ((FLASH_LOG_START_ADDRESS - FLASH_BASE) < image_end) {
+        return -ENOSPC;
+    }
+
+    /* Rebuild key index, sector sequences and erase counts. Slots are written in order,
+     * the first erased one ends the sector. */
+    for (uint8_t sector = 0; sector < FLASH_LOG_SECTORS_NUM; ++sector) {
+        for (uint16_t slot = FLASH_LOG_FIRST_SLOT(sector); slot < FLASH_LOG_FIRST_SLOT(sector + 1); ++slot) {
+            if (flash_log_is_erased(FLASH_LOG_SLOT_ADDRESS(slot), FLASH_LOG_SLOT_SIZE)) {
+                break;
+            }
+            if (!flash_log_slot_is_valid(slot)) {
+                continue;
+            }
+
+            const flash_log_header_t *header = flash_log_slot_header(slot);
+            ctx.sector_sequence[sector] = header->sequence;
+            ctx.erase_count[sector] = header->erase_count;
+
+            if ((ctx.key_slot[header->key] == FLASH_LOG_NO_SLOT) || flash_log_slot_is_newer(slot, ctx.key_slot[header->key])) {
+                ctx.key_slot[header->key] = slot;
+            }
+            if (header->sequence > head_sequence) {
+                head_sequence = header->sequence;
+                ctx.head = sector;
+            }
+        }
+        max_erase_count = UTILS_MAX(max_erase_count, ctx.erase_count[sector]);
+    }
+
+    /* Count of an empty sector is lost with its records, assume the worst one */
+    for (uint8_t sector = 0; sector < FLASH_LOG_SECTORS_NUM; ++sector) {
+        if (ctx.sector_sequence[sector] == 0) {
+            ctx.erase_count[sector] = max_erase_count;
+        }
+    }
+
+    /* Blank or foreign content */
+    if (head_sequence == 0) {
+        const int err = flash_log_format();
+        if (err) {
+            return err;
+        }
+        ctx.ready = true;
+        return 0;
+    }
+
+    ctx.next_sequence = head_sequence + 1;
+    while ((ctx.head_slot < FLASH_LOG_SLOTS_PER_SECTOR) &&
+           !flash_log_is_erased(FLASH_LOG_SLOT_ADDRESS(FLASH_LOG_FIRST_SLOT(ctx.head) + ctx.head_slot), FLASH_LOG_SLOT_SIZE)) {
+        ++ctx.head_slot;
+    }
+
+    /* Sector after head is not erased only if collecting it was interrupted, finish the job */
+    const uint8_t next = FLASH_LOG_NEXT_SECTOR(ctx.head);
+    if (!flash_log_is_erased(FLASH_LOG_SECTOR_ADDRESS(next), FLASH_LOG_SECTOR_SIZE)) {
+        const int err = flash_log_collect(next);
+        if (err) {
+            return err;
+        }
+    }
+
+    ctx.ready = true;
+
+    return 0;
+}
+
+int flash_log_write(uint16_t key, const void *data, size_t size)
+{
+    if ((key >= FLASH_LOG_KEYS_NUM) || (data == NULL) || (size > FLASH_LOG_DATA_MAX_SIZE)) {
+        return -EINVAL;
+    }
+    if (!ctx.ready) {
+        return -EIO;
+    }
+
+    /* Collecting can fill the fresh head with live records, then move on */
+    while (ctx.head_slot >= FLASH_LOG_SLOTS_PER_SECTOR) {
+        const int err = flash_log_advance();
+        if (err) {
+            return err;
+        }
+    }
+
+    return flash_log_program(key, data, size);
+}
+
+int flash_log_read(uint16_t key, void *data, size_t size)
+{
+    if ((key >= FLASH_LOG_KEYS_NUM) || (data == NULL)) {
+        return -EINVAL;
+    }
+    if (!ctx.ready) {
+        return -EIO;
+    }
+
+    const uint16_t slot = ctx.key_slot[key];
+    if (slot == FLASH_LOG_NO_SLOT) {
+        return -ENOENT;
+    }
+
+    const flash_log_header_t *header = flash_log_slot_header(slot);
+    memcpy(data, header + 1, UTILS_MIN(size, header->size));
+
+    return 0;
+}
+
+uint32_t flash_log_get_erase_count(size_t sector)
+{
+    if (sector >= FLASH_LOG_SECTORS_NUM) {
+        return 0;
+    }
+
+    return ctx.erase_count[sector];
+}
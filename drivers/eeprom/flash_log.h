@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <eeprom.h>
+
+/* Circular log of keyed records spread over FLASH_LOG_SECTORS_NUM erase sectors. Each record takes
+ * one 64-byte slot written with a single fast page program, the latest record of a key is its value.
+ * Sectors are filled in turn and the one after the head is always kept erased, so every sector
+ * wears at the same rate and capacity grows with the number of sectors.
+ *
+ * NOTE: The region ends right below legacy EEPROM emulation pages. CMake reserves it in the
+ * linker script from the same settings, keep both in sync when building otherwise -
+ * flash_log_init() refuses to run over code. */
+/* 1 KB sectors hold 16 slots, so a sector is erased once per about 16 writes. 64-byte sectors
+ * hold a single slot and need an erase on every write, wearing flash faster than legacy EEPROM
+ * emulation - use them only when the image cannot spare the flash. */
+#ifndef FLASH_LOG_1K_SECTORS
+#define FLASH_LOG_1K_SECTORS 1
+#endif
+
+#if FLASH_LOG_1K_SECTORS
+#define FLASH_LOG_SECTOR_SIZE 1024 // Standard erase
+#ifndef FLASH_LOG_SECTORS_NUM
+#define FLASH_LOG_SECTORS_NUM 2
+#endif
+#else
+#define FLASH_LOG_SECTOR_SIZE 64 // Fast erase
+#ifndef FLASH_LOG_SECTORS_NUM
+#define FLASH_LOG_SECTORS_NUM 4
+#endif
+#endif
+
+#ifndef FLASH_LOG_KEYS_NUM
+#define FLASH_LOG_KEYS_NUM 2
+#endif
+
+#define FLASH_LOG_END_ADDRESS (EEPROM_START_ADDRESS & ~(FLASH_LOG_SECTOR_SIZE - 1))
+#define FLASH_LOG_START_ADDRESS (FLASH_LOG_END_ADDRESS - (FLASH_LOG_SECTORS_NUM * FLASH_LOG_SECTOR_SIZE))
+
+#define FLASH_LOG_DATA_MAX_SIZE 48 // Slot minus header and CRC
+
+/* Scans every slot once, so boot time depends on the region size only, not on the number of writes */
+int flash_log_init(void);
+
+/* Stores a new value of the key, old one stays readable until the new one is complete */
+int flash_log_write(uint16_t key, const void *data, size_t size);
+/* Copies at most size bytes of the latest value, -ENOENT if the key was never written */
+int flash_log_read(uint16_t key, void *data, size_t size);
+
+uint32_t flash_log_get_erase_count(size_t sector);
@@ -13,6 +13,9 @@ void gpio_init(void)
     /* Configure LCD GPIO */
     gpio_cfg.GPIO_Pin = GPIO_LCD_RS_PIN | GPIO_LCD_E_PIN | GPIO_LCD_D4_PIN |
                         GPIO_LCD_D5_PIN | GPIO_LCD_D6_PIN | GPIO_LCD_D7_PIN;
+#ifdef GPIO_LCD_RW_PIN
+    gpio_cfg.GPIO_Pin |= GPIO_LCD_RW_PIN;
+#endif
     gpio_cfg.GPIO_Mode = GPIO_Mode_Out_PP;
     gpio_cfg.GPIO_Speed = GPIO_Speed_10MHz;
     GPIO_Init(GPIO_LCD_PORT, &gpio_cfg);
@@ -36,16 +39,28 @@ void gpio_init(void)
     GPIO_WriteBit(GPIO_SPI_PORT, GPIO_SPI_PGA_CS_PIN, Bit_SET);
     GPIO_WriteBit(GPIO_SPI_PORT, GPIO_SPI_DDS_CS_PIN, Bit_SET);
 
+#ifdef ENCODER_HW_TIMER
+    /* Phases are counted by timer encoder interface, route them to its inputs */
+    GPIO_PinRemapConfig(GPIO_ENC_TIMER_REMAP, ENABLE);
+#endif
+
     /* Configure EXTI for encoder inputs */
     GPIO_EXTILineConfig(GPIO_ENC_PORT_SOURCE, GPIO_ENC_BUTTON_PIN_SOURCE);
-    GPIO_EXTILineConfig(GPIO_ENC_PORT_SOURCE, GPIO_ENC_PHA_PIN_SOURCE);
-    GPIO_EXTILineConfig(GPIO_ENC_PORT_SOURCE, GPIO_ENC_PHB_PIN_SOURCE);
-    exti_cfg.EXTI_Line = GPIO_ENC_PHA_PIN | GPIO_ENC_PHB_PIN | GPIO_ENC_BUTTON_PIN;
+    exti_cfg.EXTI_Line = GPIO_ENC_BUTTON_PIN;
     exti_cfg.EXTI_Mode = EXTI_Mode_Interrupt;
-    exti_cfg.EXTI_Trigger = EXTI_Trigger_Falling;
+    exti_cfg.EXTI_Trigger = EXTI_Trigger_Rising_Falling; // Both press and release are queued as events
     exti_cfg.EXTI_LineCmd = ENABLE;
     EXTI_Init(&exti_cfg);
 
+#ifndef ENCODER_HW_TIMER
+    /* Quadrature decoder needs both edges of both phases */
+    GPIO_EXTILineConfig(GPIO_ENC_PORT_SOURCE, GPIO_ENC_PHA_PIN_SOURCE);
+    GPIO_EXTILineConfig(GPIO_ENC_PORT_SOURCE, GPIO_ENC_PHB_PIN_SOURCE);
+    exti_cfg.EXTI_Line = GPIO_ENC_PHA_PIN | GPIO_ENC_PHB_PIN;
+    exti_cfg.EXTI_Trigger = EXTI_Trigger_Rising_Falling;
+    EXTI_Init(&exti_cfg);
+#endif
+
     /* Configure NVIC */
     nvic_cfg.NVIC_IRQChannel = EXTI7_0_IRQn;
     nvic_cfg.NVIC_IRQChannelPreemptionPriority = 1;
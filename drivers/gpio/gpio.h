@@ -9,20 +9,35 @@
 #define GPIO_LCD_D5_PIN GPIO_Pin_4
 #define GPIO_LCD_D6_PIN GPIO_Pin_5
 #define GPIO_LCD_D7_PIN GPIO_Pin_6
+/* RW is tied to ground on this board, define GPIO_LCD_RW_PIN if it is wired to GPIO_LCD_PORT
+ * to let the display driver poll busy flag instead of waiting fixed delays */
 
 #define GPIO_ENC_PORT GPIOC
 #define GPIO_ENC_PORT_SOURCE GPIO_PortSourceGPIOC
 #define GPIO_ENC_BUTTON_PIN GPIO_Pin_2
 #define GPIO_ENC_BUTTON_PIN_SOURCE GPIO_PinSource2
+#ifdef ENCODER_HW_TIMER
+/* Timer encoder interface only takes phases on TIM2 CH1/CH2, the board needs a rework:
+ * full remap puts CH1 on PC1 and CH2 on PC7, so PHA and PHB go there and PGA chip
+ * select moves to PC4, freed by PHA. Other TIM2 mappings collide with LCD or SPI pins. */
+#define GPIO_ENC_TIMER_REMAP GPIO_FullRemap_TIM2
+#define GPIO_ENC_PHA_PIN GPIO_Pin_1
+#define GPIO_ENC_PHB_PIN GPIO_Pin_7
+#else
 #define GPIO_ENC_PHA_PIN GPIO_Pin_4
 #define GPIO_ENC_PHA_PIN_SOURCE GPIO_PinSource4
 #define GPIO_ENC_PHB_PIN GPIO_Pin_3
 #define GPIO_ENC_PHB_PIN_SOURCE GPIO_PinSource3
+#endif
 
 #define GPIO_SPI_PORT GPIOC
 #define GPIO_SPI_SCK_PIN GPIO_Pin_5
 #define GPIO_SPI_MOSI_PIN GPIO_Pin_6
 #define GPIO_SPI_DDS_CS_PIN GPIO_Pin_0
+#ifdef ENCODER_HW_TIMER
+#define GPIO_SPI_PGA_CS_PIN GPIO_Pin_4
+#else
 #define GPIO_SPI_PGA_CS_PIN GPIO_Pin_1
+#endif
 
 void gpio_init(void);
@@ -4,6 +4,54 @@
 #include <errno.h>
 
 #define SPI_TIMEOUT_MS 100
+#define SPI_QUEUE_MASK (SPI_QUEUE_SIZE - 1)
+
+/* CTLR1 bits taken from device descriptor */
+#define SPI_DEVICE_CONFIG_MASK (SPI_CPOL_High | SPI_CPHA_2Edge | SPI_DataSize_16b | SPI_BaudRatePrescaler_256)
+
+/* TIM1 update event is mapped to DMA1 channel 5 (RM, DMA1 request mapping) */
+#define SPI_STREAM_TIMER TIM1
+#define SPI_STREAM_DMA_CHANNEL DMA1_Channel5
+#define SPI_STREAM_DMA_IRQ DMA1_Channel5_IRQn
+#define SPI_STREAM_DMA_IT_TC DMA1_IT_TC5
+#define SPI_STREAM_TIMER_MAX_PERIOD 0x10000
+#define SPI_STREAM_FRAME_BITS 16
+#define SPI_STREAM_RATE_MARGIN 2 // Frame period at least twice the transfer time
+
+#define SPI_MSTATUS_IRQ_BITS 0x88 // MIE and MPIE, same bits __disable_irq() clears
+
+typedef struct
+{
+    const spi_device_t *device;
+    uint16_t frame;
+} spi_queue_entry_t;
+
+typedef struct
+{
+    spi_queue_entry_t entries[SPI_QUEUE_SIZE];
+    volatile uint8_t head; // Written by producers
+    volatile uint8_t tail; // Written by SPI interrupt
+    volatile bool busy; // Transfer in progress, interrupt owns the bus
+    const spi_device_t *current; // Device the bus is currently configured for
+    uint16_t config; // Cached device dependent part of CTLR1
+} spi_queue_t;
+
+typedef struct
+{
+    spi_queue_entry_t entries[SPI_QUEUE_SIZE];
+    size_t count;
+    bool open;
+} spi_batch_t;
+
+typedef struct
+{
+    spi_queue_t queue;
+    spi_batch_t batch;
+    spi_stats_t stats;
+    volatile bool stream_running;
+} spi_ctx_t;
+
+static spi_ctx_t ctx;
 
 static int spi_wait_for_flag(uint32_t flag, FlagStatus status)
 {
@@ -21,9 +69,64 @@ static int spi_wait_for_flag(uint32_t flag, FlagStatus status)
     return 0;
 }
 
+static uint16_t spi_get_device_config(const spi_device_t *device)
+{
+    static const uint16_t mode_bits[SPI_MODE_COUNT] = {
+        [SPI_MODE_0] = SPI_CPOL_Low | SPI_CPHA_1Edge,
+        [SPI_MODE_1] = SPI_CPOL_Low | SPI_CPHA_2Edge,
+        [SPI_MODE_2] = SPI_CPOL_High | SPI_CPHA_1Edge,
+        [SPI_MODE_3] = SPI_CPOL_High | SPI_CPHA_2Edge
+    };
+
+    return mode_bits[device->mode] | device->data_size | device->prescaler;
+}
+
+static bool spi_needs_reconfig(const spi_device_t *from, const spi_device_t *to)
+{
+    if ((from == to) || (from == NULL)) {
+        return false;
+    }
+
+    return spi_get_device_config(from) != spi_get_device_config(to);
+}
+
+/* Must be called between frames, frame format can't be changed with SPI enabled */
+static void spi_configure(const spi_device_t *device)
+{
+    if (ctx.queue.current == device) {
+        return;
+    }
+
+    const uint16_t config = spi_get_device_config(device);
+    if (config == ctx.queue.config) {
+        ++ctx.stats.reconfigs_cached;
+    }
+    else {
+        SPI_HANDLE->CTLR1 &= ~SPI_CTLR1_SPE;
+        SPI_HANDLE->CTLR1 = (SPI_HANDLE->CTLR1 & ~SPI_DEVICE_CONFIG_MASK) | config;
+        SPI_HANDLE->CTLR1 |= SPI_CTLR1_SPE;
+        ctx.queue.config = config;
+        ++ctx.stats.reconfigs;
+    }
+
+    ctx.queue.current = device;
+}
+
+/* Called with SPI interrupt masked or from the interrupt itself */
+static void spi_queue_send_next(void)
+{
+    const spi_queue_entry_t *entry = &ctx.queue.entries[ctx.queue.tail];
+
+    spi_configure(entry->device);
+    GPIO_WriteBit(entry->device->cs_port, entry->device->cs_pin, Bit_RESET);
+    SPI_I2S_SendData(SPI_HANDLE, entry->frame);
+    SPI_I2S_ITConfig(SPI_HANDLE, SPI_I2S_IT_TXE, ENABLE);
+}
+
 void spi_init(void)
 {
     SPI_InitTypeDef spi_cfg = {0};
+    NVIC_InitTypeDef nvic_cfg = {0};
 
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_SPI1, ENABLE);
 
@@ -39,19 +142,338 @@ void spi_init(void)
     SPI_Init(SPI_HANDLE, &spi_cfg);
 
     SPI_Cmd(SPI_HANDLE, ENABLE);
+
+    ctx.queue.config = spi_cfg.SPI_CPOL | spi_cfg.SPI_CPHA | spi_cfg.SPI_DataSize | spi_cfg.SPI_BaudRatePrescaler;
+
+    /* Highest priority, so that the queue keeps draining when producers block in interrupts */
+    nvic_cfg.NVIC_IRQChannel = SPI1_IRQn;
+    nvic_cfg.NVIC_IRQChannelPreemptionPriority = 0;
+    nvic_cfg.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic_cfg);
+}
+
+/* Critical section that can be entered from interrupts too, unlike __disable_irq()/__enable_irq()
+ * pair it does not turn interrupts on in the middle of a handler */
+static uint32_t spi_irq_save(void)
+{
+    const uint32_t state = __get_MSTATUS() & SPI_MSTATUS_IRQ_BITS;
+
+    __disable_irq();
+
+    return state;
+}
+
+static void spi_irq_restore(uint32_t state)
+{
+    __set_MSTATUS((__get_MSTATUS() & ~SPI_MSTATUS_IRQ_BITS) | state);
 }
 
-int spi_write(const void *data, size_t size)
+static int spi_queue_push(const spi_device_t *device, uint16_t frame)
 {
-    const uint16_t *data_ptr = data;
+    const uint32_t start_tick = delay_get_ticks();
+    uint32_t irq_state;
+
+    /* Producers can be both main loop and other interrupts, so the slot is claimed with interrupts
+     * masked. One is always left empty to tell full queue from empty one. */
+    while (1) {
+        irq_state = spi_irq_save();
+        if (((ctx.queue.head + 1) & SPI_QUEUE_MASK) != ctx.queue.tail) {
+            break;
+        }
+        spi_irq_restore(irq_state);
+
+        if ((delay_get_ticks() - start_tick) >= SPI_TIMEOUT_MS) {
+            return -ETIMEDOUT;
+        }
+    }
+
+    ctx.queue.entries[ctx.queue.head].device = device;
+    ctx.queue.entries[ctx.queue.head].frame = frame;
+    ctx.queue.head = (ctx.queue.head + 1) & SPI_QUEUE_MASK;
+
+    if (!ctx.queue.busy) {
+        ctx.queue.busy = true;
+        spi_queue_send_next();
+    }
+
+    spi_irq_restore(irq_state);
+
+    return 0;
+}
+
+/* Device the next queued frame will follow on the bus */
+static const spi_device_t *spi_queue_last_device(void)
+{
+    const spi_device_t *device;
+
+    const uint32_t irq_state = spi_irq_save();
+    if (ctx.queue.busy) {
+        device = ctx.queue.entries[(ctx.queue.head - 1) & SPI_QUEUE_MASK].device;
+    }
+    else {
+        device = ctx.queue.current;
+    }
+    spi_irq_restore(irq_state);
+
+    return device;
+}
+
+static int spi_batch_submit(void)
+{
+    spi_batch_t *batch = &ctx.batch;
+    const spi_device_t *last = spi_queue_last_device();
+    const spi_device_t *device = last;
+    uint32_t reconfigs_in_order = 0;
+    uint32_t reconfigs_grouped = 0;
+    uint16_t sent_mask = 0;
+    size_t sent = 0;
+    int err = 0;
+
+    /* Reconfigurations the batch would take in submission order */
+    for (size_t i = 0; i < batch->count; ++i) {
+        if (spi_needs_reconfig(last, batch->entries[i].device)) {
+            ++reconfigs_in_order;
+        }
+        last = batch->entries[i].device;
+    }
+
+    /* Send frames of the current device first, then the remaining ones device by device,
+     * in order of their first appearance */
+    while ((sent < batch->count) && !err) {
+        bool found = false;
+
+        for (size_t i = 0; i < batch->count; ++i) {
+            if ((sent_mask & (1 << i)) || (batch->entries[i].device != device)) {
+                continue;
+            }
+
+            err = spi_queue_push(device, batch->entries[i].frame);
+            if (err) {
+                break;
+            }
+            sent_mask |= (1 << i);
+            ++sent;
+            found = true;
+        }
+
+        if (found || err) {
+            continue;
+        }
+
+        for (size_t i = 0; i < batch->count; ++i) {
+            if (!(sent_mask & (1 << i))) {
+                if (spi_needs_reconfig(device, batch->entries[i].device)) {
+                    ++reconfigs_grouped;
+                }
+                device = batch->entries[i].device;
+                break;
+            }
+        }
+    }
+
+    if (reconfigs_in_order > reconfigs_grouped) {
+        ctx.stats.reconfigs_reordered += reconfigs_in_order - reconfigs_grouped;
+    }
+    batch->count = 0;
 
-    for (size_t i = 0; i < size; ++i) {
-        SPI_I2S_SendData(SPI_HANDLE, data_ptr[i]); // Why is it called SPI_I2S...?
-        const int err = spi_wait_for_flag(SPI_I2S_FLAG_TXE, SET);
+    return err;
+}
+
+int spi_queue_write(const spi_device_t *device, uint16_t frame)
+{
+    if ((device == NULL) || (device->mode >= SPI_MODE_COUNT)) {
+        return -EINVAL;
+    }
+
+    if (ctx.stream_running) {
+        return -EBUSY;
+    }
+
+    if (!ctx.batch.open) {
+        return spi_queue_push(device, frame);
+    }
+
+    /* Batch larger than the queue is split into several groups */
+    if (ctx.batch.count == SPI_QUEUE_SIZE) {
+        const int err = spi_batch_submit();
         if (err) {
             return err;
         }
     }
 
+    ctx.batch.entries[ctx.batch.count].device = device;
+    ctx.batch.entries[ctx.batch.count].frame = frame;
+    ++ctx.batch.count;
+
     return 0;
 }
+
+void spi_batch_begin(void)
+{
+    ctx.batch.open = true;
+}
+
+int spi_batch_commit(void)
+{
+    ctx.batch.open = false;
+
+    return spi_batch_submit();
+}
+
+int spi_queue_flush(void)
+{
+    const uint32_t start_tick = delay_get_ticks();
+
+    while (ctx.queue.busy) {
+        if ((delay_get_ticks() - start_tick) >= SPI_TIMEOUT_MS) {
+            return -ETIMEDOUT;
+        }
+    }
+
+    return 0;
+}
+
+bool spi_queue_is_idle(void)
+{
+    return !ctx.queue.busy;
+}
+
+void spi_select(const spi_device_t *device)
+{
+    spi_configure(device);
+    GPIO_WriteBit(device->cs_port, device->cs_pin, Bit_RESET);
+}
+
+void spi_deselect(const spi_device_t *device)
+{
+    GPIO_WriteBit(device->cs_port, device->cs_pin, Bit_SET);
+}
+
+void spi_get_stats(spi_stats_t *stats)
+{
+    const uint32_t irq_state = spi_irq_save();
+    *stats = ctx.stats;
+    spi_irq_restore(irq_state);
+}
+
+/* DMA writes the next frame on every timer event whether the previous one is out or not,
+ * so the rate has to stay below what the selected device's SPI clock can shift */
+static uint32_t spi_stream_get_max_rate(void)
+{
+    const uint32_t divider = 2U << ((ctx.queue.config & SPI_BaudRatePrescaler_256) >> 3);
+
+    return SystemCoreClock / (SPI_STREAM_FRAME_BITS * SPI_STREAM_RATE_MARGIN * divider);
+}
+
+int spi_stream_start(const uint16_t *data, size_t count, uint32_t rate_hz, bool circular)
+{
+    DMA_InitTypeDef dma_cfg = {0};
+    TIM_TimeBaseInitTypeDef tim_cfg = {0};
+    NVIC_InitTypeDef nvic_cfg = {0};
+
+    if ((data == NULL) || (count == 0) || (count > UINT16_MAX) || (rate_hz == 0) || (rate_hz > spi_stream_get_max_rate())) {
+        return -EINVAL;
+    }
+
+    /* Queue and stream can't share the bus */
+    if (ctx.stream_running || ctx.queue.busy) {
+        return -EBUSY;
+    }
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
+
+    /* Each timer update request moves one frame from memory to SPI data register */
+    DMA_DeInit(SPI_STREAM_DMA_CHANNEL);
+    dma_cfg.DMA_PeripheralBaseAddr = (uint32_t)&SPI_HANDLE->DATAR;
+    dma_cfg.DMA_MemoryBaseAddr = (uint32_t)data;
+    dma_cfg.DMA_DIR = DMA_DIR_PeripheralDST;
+    dma_cfg.DMA_BufferSize = count;
+    dma_cfg.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    dma_cfg.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    dma_cfg.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    dma_cfg.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    dma_cfg.DMA_Mode = circular ? DMA_Mode_Circular : DMA_Mode_Normal;
+    dma_cfg.DMA_Priority = DMA_Priority_High;
+    dma_cfg.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(SPI_STREAM_DMA_CHANNEL, &dma_cfg);
+
+    /* One-shot streams stop the timer on completion, that's the only interrupt involved */
+    if (!circular) {
+        DMA_ClearITPendingBit(SPI_STREAM_DMA_IT_TC);
+        DMA_ITConfig(SPI_STREAM_DMA_CHANNEL, DMA_IT_TC, ENABLE);
+
+        nvic_cfg.NVIC_IRQChannel = SPI_STREAM_DMA_IRQ;
+        nvic_cfg.NVIC_IRQChannelPreemptionPriority = 1;
+        nvic_cfg.NVIC_IRQChannelCmd = ENABLE;
+        NVIC_Init(&nvic_cfg);
+    }
+
+    /* Split the period into prescaler and reload value, both are 16-bit */
+    const uint32_t period = SystemCoreClock / rate_hz;
+    const uint32_t prescaler = period / SPI_STREAM_TIMER_MAX_PERIOD;
+    tim_cfg.TIM_Prescaler = prescaler;
+    tim_cfg.TIM_CounterMode = TIM_CounterMode_Up;
+    tim_cfg.TIM_Period = (period / (prescaler + 1)) - 1;
+    tim_cfg.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInit(SPI_STREAM_TIMER, &tim_cfg);
+    TIM_DMACmd(SPI_STREAM_TIMER, TIM_DMA_Update, ENABLE);
+
+    ctx.stream_running = true;
+    DMA_Cmd(SPI_STREAM_DMA_CHANNEL, ENABLE);
+    TIM_Cmd(SPI_STREAM_TIMER, ENABLE);
+
+    return 0;
+}
+
+void spi_stream_stop(void)
+{
+    TIM_Cmd(SPI_STREAM_TIMER, DISABLE);
+    TIM_DMACmd(SPI_STREAM_TIMER, TIM_DMA_Update, DISABLE);
+    DMA_Cmd(SPI_STREAM_DMA_CHANNEL, DISABLE);
+    DMA_ITConfig(SPI_STREAM_DMA_CHANNEL, DMA_IT_TC, DISABLE);
+    NVIC_DisableIRQ(SPI_STREAM_DMA_IRQ);
+
+    /* Let the last frame leave the shift register */
+    spi_wait_for_flag(SPI_I2S_FLAG_BSY, RESET);
+
+    ctx.stream_running = false;
+}
+
+bool spi_stream_is_running(void)
+{
+    return ctx.stream_running;
+}
+
+void SPI1_IRQHandler(void)
+{
+    if (SPI_I2S_GetITStatus(SPI_HANDLE, SPI_I2S_IT_TXE) == RESET) {
+        return;
+    }
+
+    /* TXE is set once the frame moves to shift register, chip select can be raised
+     * only after it has been clocked out, which takes just 16 SPI clock cycles */
+    while (SPI_I2S_GetFlagStatus(SPI_HANDLE, SPI_I2S_FLAG_BSY) == SET);
+
+    const spi_device_t *device = ctx.queue.entries[ctx.queue.tail].device;
+    GPIO_WriteBit(device->cs_port, device->cs_pin, Bit_SET);
+    ++ctx.stats.frames;
+    ctx.queue.tail = (ctx.queue.tail + 1) & SPI_QUEUE_MASK;
+
+    if (ctx.queue.tail == ctx.queue.head) {
+        SPI_I2S_ITConfig(SPI_HANDLE, SPI_I2S_IT_TXE, DISABLE);
+        ctx.queue.busy = false;
+        return;
+    }
+
+    spi_queue_send_next();
+}
+
+void DMA1_Channel5_IRQHandler(void)
+{
+    if (DMA_GetITStatus(SPI_STREAM_DMA_IT_TC)) {
+        DMA_ClearITPendingBit(SPI_STREAM_DMA_IT_TC);
+        TIM_Cmd(SPI_STREAM_TIMER, DISABLE);
+        ctx.stream_running = false;
+    }
+}
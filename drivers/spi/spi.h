@@ -1,9 +1,69 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ch32v00x.h>
 
 #define SPI_HANDLE SPI1
+#define SPI_QUEUE_SIZE 16 // Must be a power of two
+
+typedef enum
+{
+    SPI_MODE_0 = 0, // CPOL = 0, CPHA = 0
+    SPI_MODE_1, // CPOL = 0, CPHA = 1
+    SPI_MODE_2, // CPOL = 1, CPHA = 0
+    SPI_MODE_3, // CPOL = 1, CPHA = 1
+    SPI_MODE_COUNT
+} spi_mode_t;
+
+typedef struct
+{
+    spi_mode_t mode;
+    GPIO_TypeDef *cs_port;
+    uint16_t cs_pin;
+    uint16_t data_size; // SPI_DataSize_8b or SPI_DataSize_16b
+    uint16_t prescaler; // SPI_BaudRatePrescaler_x
+} spi_device_t;
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t reconfigs; // Peripheral reconfigurations actually done
+    uint32_t reconfigs_cached; // Device switches that found the peripheral already configured
+    uint32_t reconfigs_reordered; // Reconfigurations avoided by grouping batched frames
+} spi_stats_t;
 
 void spi_init(void);
 
-int spi_write(const void *data, size_t size);
+/* Queues a single 16-bit frame for the device and returns right away, frames are sent
+ * from SPI interrupt, each one framed by its own chip select pulse. Blocks only if the
+ * queue is full, until there is space or timeout expires. Safe to call from interrupts
+ * of priority lower than SPI one. */
+int spi_queue_write(const spi_device_t *device, uint16_t frame);
+
+/* Frames queued between spi_batch_begin() and spi_batch_commit() are held back and then
+ * grouped per device, keeping their order within each device, so that the peripheral
+ * is reconfigured as rarely as possible. Batches are not reentrant, use them from one context. */
+void spi_batch_begin(void);
+int spi_batch_commit(void);
+
+/* Waits until all queued frames are sent */
+int spi_queue_flush(void);
+bool spi_queue_is_idle(void);
+
+/* Direct device selection for streaming, queue has to be flushed first */
+void spi_select(const spi_device_t *device);
+void spi_deselect(const spi_device_t *device);
+
+void spi_get_stats(spi_stats_t *stats);
+
+/* Streams 16-bit frames to SPI data register with DMA, paced by TIM1 update events,
+ * without any CPU involvement. Chip select handling is up to the caller. Rate is limited to
+ * half the frame rate of the selected device, SystemCoreClock / (32 * SPI prescaler). */
+int spi_stream_start(const uint16_t *data, size_t count, uint32_t rate_hz, bool circular);
+void spi_stream_stop(void);
+bool spi_stream_is_running(void);
+
+void SPI1_IRQHandler(void) __attribute__((interrupt));
+void DMA1_Channel5_IRQHandler(void) __attribute__((interrupt));
@@ -3,134 +3,365 @@
 #include <delay.h>
 #include <string.h>
 
-#define ENCODER_BUTTON_DEBOUNCE_TIME_MS 100
+#define ENCODER_BUTTON_DEBOUNCE_TIME_MS 30 // Edges are ignored for that long after an accepted one
 #define ENCODER_BUTTON_HOLD_TIME_MS 750
 
+#define ENCODER_EVENT_QUEUE_SIZE 16 // Must be a power of two
+#define ENCODER_EVENT_QUEUE_MASK (ENCODER_EVENT_QUEUE_SIZE - 1)
+
+#define ENCODER_STEPS_PER_CYCLE 4 // Quadrature cycle has four edges
+#define ENCODER_ACCEL_NO_GAIN 1
+
+#ifdef ENCODER_HW_TIMER
+#ifdef HD44780_IO_ASYNC
+#error "ENCODER_HW_TIMER and HD44780_IO_ASYNC both need TIM2"
+#endif
+#define ENCODER_TIMER TIM2
+#define ENCODER_TIMER_IRQ TIM2_IRQn
+#define ENCODER_TIMER_FILTER 0x0F // Longest input filter, 8 samples at fDTS/32
+#else
+#define ENCODER_INVALID 2 // Transition table marker, both phases changed
+
+/* Phase state is (PHB << 1) | PHA, clockwise rotation goes 11 -> 10 -> 00 -> 01 -> 11 */
+#define ENCODER_STATE(indr) (((((indr) & GPIO_ENC_PHB_PIN) != 0) << 1) | (((indr) & GPIO_ENC_PHA_PIN) != 0))
+#endif
+
 typedef enum
 {
-	ENCODER_BUTTON_STATE_IDLE = 0,
-	ENCODER_BUTTON_STATE_DEBOUNCE,
-	ENCODER_BUTTON_STATE_CLICKED,
-	ENCODER_BUTTON_STATE_HELD,
-	ENCODER_BUTTON_STATE_WAITING, // Wait for release after hold to avoid repeating the hold action
-	ENCODER_BUTTON_STATE_RELEASED
-} encoder_button_state_t;
+	ENCODER_EVENT_ROTATE,
+	ENCODER_EVENT_PRESS,
+	ENCODER_EVENT_RELEASE,
+	ENCODER_EVENT_HOLD
+} encoder_event_type_t;
 
 typedef struct
 {
-	volatile bool enc_cw_fall;
-	volatile bool enc_ccw_fall;
-	volatile uint32_t enc_count;
-	uint32_t enc_last_count;
-	volatile bool enc_rotated;
+	uint32_t timestamp; // Raw, converted by the consumer to keep division out of interrupts
+	int16_t increment;
+	int16_t accel_increment;
+	encoder_event_type_t type;
+} encoder_event_t;
+
+/* Fields up to the queue are owned by the producer - encoder interrupts, which share one priority
+ * level, or the task with them masked. The rest is owned by the consumer - encoder_task(). */
+typedef struct
+{
+#ifdef ENCODER_HW_TIMER
+	uint16_t enc_position; // Timer counter value of the last full count
+#else
+	uint8_t enc_state;
+	int8_t enc_steps; // Edges accumulated towards the next count
+#endif
+	uint8_t enc_steps_per_count;
+	volatile uint32_t enc_invalid;
+	uint32_t enc_count_tick; // Timestamp of the last count
+	int8_t enc_last_dir;
+	int16_t enc_pending; // Counts not queued yet because the queue was full
+	int16_t enc_accel_pending;
+	const encoder_accel_step_t *accel_curve;
+	size_t accel_curve_size;
+	bool button_pressed; // Last level reported in the queue
+	bool button_hold_sent;
+	uint32_t button_edge_tick;
+
+	encoder_event_t events[ENCODER_EVENT_QUEUE_SIZE];
+	volatile uint8_t events_head; // Written by producer
+	volatile uint8_t events_tail; // Written by consumer
+
+	uint32_t enc_count;
+	bool button_down; // Button state as seen by consumer
+	bool button_held;
+	uint32_t max_latency_us;
 	encoder_rotation_callback_t rotation_callback;
 	encoder_button_callback_t button_callback;
-	uint32_t button_event_tick;
-	encoder_button_state_t button_state;
 } encoder_ctx_t;
 
 static encoder_ctx_t ctx;
 
+#ifndef ENCODER_HW_TIMER
+/* Indexed by (previous state << 2) | current state */
+static const int8_t encoder_transitions[16] =
+{
+		0, 1, -1, ENCODER_INVALID,
+		-1, 0, ENCODER_INVALID, 1,
+		1, ENCODER_INVALID, 0, -1,
+		ENCODER_INVALID, -1, 1, 0
+};
+#endif
+
+/* Fast spin multiplies every count, defaults suit a 20-detent encoder at 1x resolution */
+static const encoder_accel_step_t encoder_default_accel_curve[] =
+{
+		{.interval_ms = 25, .gain = 10},
+		{.interval_ms = 50, .gain = 5},
+		{.interval_ms = 100, .gain = 2}
+};
+
+#define ENCODER_DEFAULT_ACCEL_CURVE_SIZE (sizeof(encoder_default_accel_curve) / sizeof(encoder_default_accel_curve[0]))
+
 static bool encoder_is_button_pressed(void)
 {
 	return (GPIO_ReadInputDataBit(GPIO_ENC_PORT, GPIO_ENC_BUTTON_PIN) == Bit_RESET);
 }
 
-static void encoder_rotation_isr(uint32_t irq_pin)
+/* Button is on EXTI in both backends, rotation either on EXTI or on encoder timer */
+static void encoder_irq_disable(void)
+{
+	NVIC_DisableIRQ(EXTI7_0_IRQn);
+#ifdef ENCODER_HW_TIMER
+	NVIC_DisableIRQ(ENCODER_TIMER_IRQ);
+#endif
+}
+
+static void encoder_irq_enable(void)
+{
+#ifdef ENCODER_HW_TIMER
+	NVIC_EnableIRQ(ENCODER_TIMER_IRQ);
+#endif
+	NVIC_EnableIRQ(EXTI7_0_IRQn);
+}
+
+/* Producer side, called from encoder interrupts or with them masked */
+static bool encoder_event_push(encoder_event_type_t type, int16_t increment, int16_t accel_increment)
 {
-	const uint8_t pha_state = GPIO_ReadInputDataBit(GPIO_ENC_PORT, GPIO_ENC_PHA_PIN);
-	const uint8_t phb_state = GPIO_ReadInputDataBit(GPIO_ENC_PORT, GPIO_ENC_PHB_PIN);
-	const uint8_t gpio_state = (phb_state << 1) | (pha_state << 0);
+	const uint8_t head = ctx.events_head;
+	const uint8_t next = (head + 1) & ENCODER_EVENT_QUEUE_MASK;
+
+	/* One slot is always left empty to tell full queue from empty one */
+	if (next == ctx.events_tail) {
+		return false;
+	}
 
-	if (irq_pin == GPIO_ENC_PHA_PIN) {
-        if (!ctx.enc_cw_fall && (gpio_state == 0b10)) {
-            ctx.enc_cw_fall = true;
-        }
+	encoder_event_t *event = &ctx.events[head];
+	event->timestamp = delay_get_timestamp();
+	event->increment = increment;
+	event->accel_increment = accel_increment;
+	event->type = type;
 
-        if (ctx.enc_ccw_fall && (gpio_state == 0b00)) {
-            ctx.enc_cw_fall = false;
-            ctx.enc_ccw_fall = false;
-            --ctx.enc_count;
-            ctx.enc_rotated = true;
-        }
-    }
-    else {
-        if (!ctx.enc_ccw_fall && (gpio_state == 0b01)) {
-            ctx.enc_ccw_fall = true;
-        }
+	/* Entry has to be complete before consumer can see it */
+	__asm volatile ("" ::: "memory");
+	ctx.events_head = next;
 
-        if (ctx.enc_cw_fall && (gpio_state == 0b00)) {
-            ctx.enc_cw_fall = false;
-            ctx.enc_ccw_fall = false;
-            ++ctx.enc_count;
-            ctx.enc_rotated = true;
-        }
-    }
+	return true;
 }
 
-static void encoder_rotation_update(void)
+static void encoder_rotation_flush(void)
 {
-	if (ctx.rotation_callback == NULL) {
+	/* Reversal can cancel raw counts out while weighted ones do not */
+	if ((ctx.enc_pending == 0) && (ctx.enc_accel_pending == 0)) {
 		return;
 	}
 
-	if (ctx.enc_rotated) {
-		ctx.enc_rotated = false;
+	if (encoder_event_push(ENCODER_EVENT_ROTATE, ctx.enc_pending, ctx.enc_accel_pending)) {
+		ctx.enc_pending = 0;
+		ctx.enc_accel_pending = 0;
+	}
+}
+
+static uint8_t encoder_accel_gain(int8_t dir)
+{
+	const uint32_t now = delay_get_ticks();
+	const uint32_t interval = now - ctx.enc_count_tick;
+	const bool reversed = (dir != ctx.enc_last_dir);
 
-		const uint32_t enc_count = ctx.enc_count;
-		const int32_t increment = enc_count - ctx.enc_last_count;
-		const encoder_direction_t direction = (increment > 0) ? ENCODER_CW : ENCODER_CCW;
+	ctx.enc_count_tick = now;
+	ctx.enc_last_dir = dir;
 
-		ctx.rotation_callback(direction, enc_count, increment);
+	/* Turning back is a correction, it should be precise */
+	if (reversed) {
+		return ENCODER_ACCEL_NO_GAIN;
+	}
 
-		ctx.enc_last_count = enc_count;
+	for (size_t i = 0; i < ctx.accel_curve_size; ++i) {
+		if (interval < ctx.accel_curve[i].interval_ms) {
+			return ctx.accel_curve[i].gain;
+		}
 	}
+
+	return ENCODER_ACCEL_NO_GAIN;
 }
 
-static void encoder_button_update(void)
+static void encoder_count(int8_t dir)
 {
-	switch (ctx.button_state) {
-		case ENCODER_BUTTON_STATE_IDLE:
-			if (encoder_is_button_pressed()) {
-				ctx.button_event_tick = delay_get_ticks();
-				ctx.button_state = ENCODER_BUTTON_STATE_DEBOUNCE;
-			}
-			break;
-		case ENCODER_BUTTON_STATE_DEBOUNCE:
-			if ((delay_get_ticks() - ctx.button_event_tick) >= ENCODER_BUTTON_DEBOUNCE_TIME_MS) {
-				if (encoder_is_button_pressed()) {
-					ctx.button_event_tick = delay_get_ticks();
-					ctx.button_state = ENCODER_BUTTON_STATE_CLICKED;
-				}
-				else {
-					ctx.button_state = ENCODER_BUTTON_STATE_IDLE;
-				}
-			}
-			break;
-		case ENCODER_BUTTON_STATE_CLICKED:
-			if ((delay_get_ticks() - ctx.button_event_tick) >= ENCODER_BUTTON_HOLD_TIME_MS) {
-				ctx.button_state = ENCODER_BUTTON_STATE_HELD;
-			}
-			else if (!encoder_is_button_pressed()) {
-				ctx.button_state = ENCODER_BUTTON_STATE_RELEASED;
+	const uint8_t gain = encoder_accel_gain(dir);
+
+	/* Counts are merged while the queue is full, so none get lost */
+	ctx.enc_pending += dir;
+	if (dir > 0) {
+		ctx.enc_accel_pending += gain;
+	}
+	else {
+		ctx.enc_accel_pending -= gain;
+	}
+	encoder_rotation_flush();
+}
+
+static void encoder_button_isr(void)
+{
+	const uint32_t now = delay_get_ticks();
+	const bool pressed = encoder_is_button_pressed();
+
+	/* Contacts went back to reported level or are still bouncing, final level is picked up by encoder_task() */
+	if ((pressed == ctx.button_pressed) || ((now - ctx.button_edge_tick) < ENCODER_BUTTON_DEBOUNCE_TIME_MS)) {
+		return;
+	}
+
+	/* Keep order of events, rotation that waited for free slot goes first */
+	encoder_rotation_flush();
+	if (!encoder_event_push(pressed ? ENCODER_EVENT_PRESS : ENCODER_EVENT_RELEASE, 0, 0)) {
+		return;
+	}
+
+	ctx.button_pressed = pressed;
+	ctx.button_hold_sent = false;
+	ctx.button_edge_tick = now;
+}
+
+#ifdef ENCODER_HW_TIMER
+/* Called with timer interrupt masked or from the interrupt itself */
+static void encoder_rotation_isr(void)
+{
+	const int16_t steps = ctx.enc_steps_per_count;
+	int16_t delta;
+
+	do {
+		/* Timer counts every edge, turn them into whole counts and leave the rest in the counter */
+		delta = (int16_t)(ENCODER_TIMER->CNT - ctx.enc_position);
+		while (delta >= steps) {
+			ctx.enc_position += steps;
+			delta -= steps;
+			encoder_count(1);
+		}
+		while (delta <= -steps) {
+			ctx.enc_position -= steps;
+			delta += steps;
+			encoder_count(-1);
+		}
+
+		/* Compare match on either side of the current position wakes the core only once next count is reached */
+		ENCODER_TIMER->CH3CVR = (uint16_t)(ctx.enc_position + steps);
+		ENCODER_TIMER->CH4CVR = (uint16_t)(ctx.enc_position - steps);
+
+		/* Counter could have passed a new compare value before it was written */
+		delta = (int16_t)(ENCODER_TIMER->CNT - ctx.enc_position);
+	} while ((delta >= steps) || (delta <= -steps));
+}
+
+static void encoder_timer_init(void)
+{
+	TIM_TimeBaseInitTypeDef tim_cfg = {0};
+	TIM_ICInitTypeDef ic_cfg = {0};
+	NVIC_InitTypeDef nvic_cfg = {0};
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+
+	/* Free-running over the whole 16-bit range, positions are compared modulo 2^16 */
+	tim_cfg.TIM_Prescaler = 0;
+	tim_cfg.TIM_CounterMode = TIM_CounterMode_Up;
+	tim_cfg.TIM_Period = UINT16_MAX;
+	tim_cfg.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseInit(ENCODER_TIMER, &tim_cfg);
+
+	/* Count both edges of both phases, same resolution as the software decoder */
+	TIM_EncoderInterfaceConfig(ENCODER_TIMER, TIM_EncoderMode_TI12, TIM_ICPolarity_Rising, TIM_ICPolarity_Rising);
+	TIM_ICStructInit(&ic_cfg);
+	ic_cfg.TIM_ICFilter = ENCODER_TIMER_FILTER;
+	ic_cfg.TIM_Channel = TIM_Channel_1;
+	TIM_ICInit(ENCODER_TIMER, &ic_cfg);
+	ic_cfg.TIM_Channel = TIM_Channel_2;
+	TIM_ICInit(ENCODER_TIMER, &ic_cfg);
+
+	/* Channels 3 and 4 stay in frozen output compare mode, only their match flags are used */
+	ctx.enc_position = ENCODER_TIMER->CNT;
+	encoder_rotation_isr();
+	TIM_ClearITPendingBit(ENCODER_TIMER, TIM_IT_CC3 | TIM_IT_CC4);
+	TIM_ITConfig(ENCODER_TIMER, TIM_IT_CC3 | TIM_IT_CC4, ENABLE);
+
+	nvic_cfg.NVIC_IRQChannel = ENCODER_TIMER_IRQ;
+	nvic_cfg.NVIC_IRQChannelPreemptionPriority = 1;
+	nvic_cfg.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&nvic_cfg);
+
+	TIM_Cmd(ENCODER_TIMER, ENABLE);
+}
+#else
+static uint8_t encoder_read_state(void)
+{
+	/* Both phases in a single read, so they are always consistent */
+	return ENCODER_STATE(GPIO_ENC_PORT->INDR);
+}
+
+static void encoder_rotation_isr(void)
+{
+	const uint8_t state = encoder_read_state();
+	const int8_t step = encoder_transitions[(ctx.enc_state << 2) | state];
+	ctx.enc_state = state;
+
+	if (step == ENCODER_INVALID) {
+		++ctx.enc_invalid;
+		return;
+	}
+
+	/* Bouncing back and forth cancels out before reaching a full count */
+	ctx.enc_steps += step;
+	if (ctx.enc_steps >= ctx.enc_steps_per_count) {
+		ctx.enc_steps = 0;
+		encoder_count(1);
+	}
+	else if (ctx.enc_steps <= -ctx.enc_steps_per_count) {
+		ctx.enc_steps = 0;
+		encoder_count(-1);
+	}
+}
+#endif
+
+/* Producer work that needs time to pass instead of an edge */
+static void encoder_timers_update(void)
+{
+	encoder_irq_disable();
+
+	/* Edge that came during debounce lockout or found the queue full */
+	encoder_button_isr();
+	encoder_rotation_flush();
+
+	if (ctx.button_pressed && !ctx.button_hold_sent &&
+		((delay_get_ticks() - ctx.button_edge_tick) >= ENCODER_BUTTON_HOLD_TIME_MS)) {
+		ctx.button_hold_sent = encoder_event_push(ENCODER_EVENT_HOLD, 0, 0);
+	}
+
+	encoder_irq_enable();
+}
+
+static void encoder_event_dispatch(const encoder_event_t *event)
+{
+	switch (event->type) {
+		case ENCODER_EVENT_ROTATE: {
+			ctx.enc_count += event->increment;
+			const int32_t sign = (event->increment != 0) ? event->increment : event->accel_increment;
+			const encoder_direction_t direction = (sign > 0) ? ENCODER_CW : ENCODER_CCW;
+			if (ctx.rotation_callback != NULL) {
+				ctx.rotation_callback(direction, ctx.enc_count, event->increment, event->accel_increment);
 			}
 			break;
-		case ENCODER_BUTTON_STATE_HELD:
-			if (ctx.button_callback != NULL) {
-				ctx.button_callback(ENCODER_BUTTON_HOLD);
-			}
-			ctx.button_state = ENCODER_BUTTON_STATE_WAITING;
+		}
+		case ENCODER_EVENT_PRESS:
+			ctx.button_down = true;
+			ctx.button_held = false;
 			break;
-		case ENCODER_BUTTON_STATE_WAITING:
-			if (!encoder_is_button_pressed()) {
-				ctx.button_state = ENCODER_BUTTON_STATE_IDLE;
+		case ENCODER_EVENT_HOLD:
+			if (ctx.button_down && !ctx.button_held) {
+				ctx.button_held = true;
+				if (ctx.button_callback != NULL) {
+					ctx.button_callback(ENCODER_BUTTON_HOLD);
+				}
 			}
 			break;
-		case ENCODER_BUTTON_STATE_RELEASED:
-			if (ctx.button_callback != NULL) {
+		case ENCODER_EVENT_RELEASE:
+			/* Release after hold only ends it, hold action is not followed by a click */
+			if (ctx.button_down && !ctx.button_held && (ctx.button_callback != NULL)) {
 				ctx.button_callback(ENCODER_BUTTON_CLICK);
 			}
-			ctx.button_state = ENCODER_BUTTON_STATE_IDLE;
+			ctx.button_down = false;
 			break;
 		default:
 			break;
@@ -140,6 +371,16 @@ static void encoder_button_update(void)
 void encoder_init(void)
 {
 	memset(&ctx, 0, sizeof(ctx));
+
+	ctx.enc_steps_per_count = ENCODER_STEPS_PER_CYCLE / ENCODER_RESOLUTION_1X;
+	ctx.accel_curve = encoder_default_accel_curve;
+	ctx.accel_curve_size = ENCODER_DEFAULT_ACCEL_CURVE_SIZE;
+	ctx.button_pressed = encoder_is_button_pressed();
+#ifdef ENCODER_HW_TIMER
+	encoder_timer_init();
+#else
+	ctx.enc_state = encoder_read_state();
+#endif
 }
 
 void encoder_set_rotation_callback(encoder_rotation_callback_t callback)
@@ -152,30 +393,102 @@ void encoder_set_button_callback(encoder_button_callback_t callback)
 	ctx.button_callback = callback;
 }
 
+void encoder_set_resolution(encoder_resolution_t resolution)
+{
+	if ((resolution != ENCODER_RESOLUTION_1X) && (resolution != ENCODER_RESOLUTION_2X) && (resolution != ENCODER_RESOLUTION_4X)) {
+		return;
+	}
+
+	encoder_irq_disable();
+	ctx.enc_steps_per_count = ENCODER_STEPS_PER_CYCLE / resolution;
+#ifdef ENCODER_HW_TIMER
+	ctx.enc_position = ENCODER_TIMER->CNT;
+	encoder_rotation_isr();
+#else
+	ctx.enc_steps = 0;
+#endif
+	encoder_irq_enable();
+}
+
+void encoder_set_acceleration(const encoder_accel_step_t *curve, size_t curve_size)
+{
+	encoder_irq_disable();
+	ctx.accel_curve = curve;
+	ctx.accel_curve_size = (curve != NULL) ? curve_size : 0;
+	encoder_irq_enable();
+}
+
+uint32_t encoder_get_invalid_transitions(void)
+{
+	return ctx.enc_invalid;
+}
+
+uint32_t encoder_get_max_latency_us(void)
+{
+	return ctx.max_latency_us;
+}
+
 bool encoder_button_is_idle(void)
 {
-	return (ctx.button_state == ENCODER_BUTTON_STATE_IDLE) && !encoder_is_button_pressed();
+	return !ctx.button_down;
+}
+
+bool encoder_has_events(void)
+{
+	return (ctx.events_head != ctx.events_tail);
+}
+
+bool encoder_needs_tick(void)
+{
+	/* Hold timer and debounce lockout count ticks, level not reported yet is picked up after lockout */
+	return ctx.button_pressed || encoder_is_button_pressed() ||
+		   ((delay_get_ticks() - ctx.button_edge_tick) < ENCODER_BUTTON_DEBOUNCE_TIME_MS);
 }
 
 void encoder_task(void)
 {
-	encoder_rotation_update();
-	encoder_button_update();
+	encoder_timers_update();
+
+	while (ctx.events_tail != ctx.events_head) {
+		const encoder_event_t *event = &ctx.events[ctx.events_tail];
+
+		const uint32_t latency_us = delay_get_elapsed_us(event->timestamp);
+		if (latency_us > ctx.max_latency_us) {
+			ctx.max_latency_us = latency_us;
+		}
+
+		encoder_event_dispatch(event);
+
+		/* Slot is handed back to producer only after the entry has been used */
+		__asm volatile ("" ::: "memory");
+		ctx.events_tail = (ctx.events_tail + 1) & ENCODER_EVENT_QUEUE_MASK;
+	}
 }
 
 void EXTI7_0_IRQHandler(void)
 {
 	if (EXTI_GetITStatus(GPIO_ENC_BUTTON_PIN)) {
 		EXTI_ClearITPendingBit(GPIO_ENC_BUTTON_PIN);
+		encoder_button_isr();
 	}
 
-	if (EXTI_GetITStatus(GPIO_ENC_PHA_PIN)) {
-		encoder_rotation_isr(GPIO_ENC_PHA_PIN);
-		EXTI_ClearITPendingBit(GPIO_ENC_PHA_PIN);
+#ifndef ENCODER_HW_TIMER
+	/* Decoder looks at both phases at once, so one pass handles edges on both of them */
+	if (EXTI_GetITStatus(GPIO_ENC_PHA_PIN) || EXTI_GetITStatus(GPIO_ENC_PHB_PIN)) {
+		EXTI_ClearITPendingBit(GPIO_ENC_PHA_PIN | GPIO_ENC_PHB_PIN);
+		encoder_rotation_isr();
 	}
+#endif
+}
 
-	if (EXTI_GetITStatus(GPIO_ENC_PHB_PIN)) {
-		encoder_rotation_isr(GPIO_ENC_PHB_PIN);
-		EXTI_ClearITPendingBit(GPIO_ENC_PHB_PIN);
+#ifdef ENCODER_HW_TIMER
+void TIM2_IRQHandler(void)
+{
+	if ((TIM_GetITStatus(ENCODER_TIMER, TIM_IT_CC3) == RESET) && (TIM_GetITStatus(ENCODER_TIMER, TIM_IT_CC4) == RESET)) {
+		return;
 	}
+	TIM_ClearITPendingBit(ENCODER_TIMER, TIM_IT_CC3 | TIM_IT_CC4);
+
+	encoder_rotation_isr();
 }
+#endif
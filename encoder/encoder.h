@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef enum
 {
@@ -9,22 +10,59 @@ typedef enum
 	ENCODER_CCW
 } encoder_direction_t;
 
+typedef enum
+{
+	ENCODER_RESOLUTION_1X = 1, // One count per full quadrature cycle, i.e. per detent
+	ENCODER_RESOLUTION_2X = 2,
+	ENCODER_RESOLUTION_4X = 4 // One count per edge
+} encoder_resolution_t;
+
 typedef enum
 {
 	ENCODER_BUTTON_CLICK,
 	ENCODER_BUTTON_HOLD
 } encoder_button_action_t;
 
-typedef void (*encoder_rotation_callback_t)(encoder_direction_t direction, uint32_t count, int32_t increment);
+/* Counts coming faster than interval_ms apart are multiplied by gain */
+typedef struct
+{
+	uint16_t interval_ms;
+	uint8_t gain;
+} encoder_accel_step_t;
+
+/* increment is the raw number of counts, accel_increment the same counts weighted by acceleration gain */
+typedef void (*encoder_rotation_callback_t)(encoder_direction_t direction, uint32_t count, int32_t increment, int32_t accel_increment);
 typedef void (*encoder_button_callback_t)(encoder_button_action_t type);
 
 void encoder_init(void);
 
 void encoder_set_rotation_callback(encoder_rotation_callback_t callback);
 void encoder_set_button_callback(encoder_button_callback_t callback);
+void encoder_set_resolution(encoder_resolution_t resolution);
+/* Curve has to be sorted by ascending interval and outlive the encoder, NULL disables acceleration.
+ * Reversing direction always counts without gain. */
+void encoder_set_acceleration(const encoder_accel_step_t *curve, size_t curve_size);
+
+/* Number of transitions with both phases changed at once - missed edges or bouncing contacts.
+ * Always zero with ENCODER_HW_TIMER, timer encoder interface does not report them. */
+uint32_t encoder_get_invalid_transitions(void);
 
+/* Worst time from an input interrupt to handling its event in encoder_task() */
+uint32_t encoder_get_max_latency_us(void);
+
+/* Button state as of the last handled event */
 bool encoder_button_is_idle(void);
 
+/* Input events are queued by interrupts and handled by encoder_task(), which calls the callbacks.
+ * With no events queued it is safe to sleep until the next interrupt, but SysTick has to keep
+ * running while encoder_needs_tick() is true - button hold and debounce are timed by it. */
+bool encoder_has_events(void);
+bool encoder_needs_tick(void);
+
 void encoder_task(void);
 
 void EXTI7_0_IRQHandler(void) __attribute__((interrupt));
+#ifdef ENCODER_HW_TIMER
+/* Phases are counted by TIM2 encoder interface, interrupt comes only once per full count */
+void TIM2_IRQHandler(void) __attribute__((interrupt));
+#endif
@@ -20,6 +20,7 @@ void error_handler_message(const char *msg)
     if (msg != NULL) {
         hd44780_gotoxy(1, 1);
         hd44780_write_string(msg);
+        hd44780_flush();
     }
 
     /* Let the user see the message */
@@ -7,6 +7,7 @@
 #include <error_handler.h>
 #include <utils.h>
 #include <math.h>
+#include <string.h>
 
 /* NOTE: In practice, the -3dB point of the analog front-end used in this module is around 1 MHz.
  * The slowest component is the MCP40101 digital potentiometer, which has an upper cutoff frequency
@@ -30,6 +31,8 @@
 #define GUI_DISP_RESOLUTION_X 2
 #define GUI_DISP_RESOLUTION_Y 16
 
+#define GUI_FREQ_LABEL "Freq:"
+
 /* Coordinates of items on display */
 #define GUI_DISP_FREQ_X 1
 #define GUI_DISP_FREQ_END_Y 14
@@ -37,14 +40,37 @@
 #define GUI_DISP_AMPL_END_Y 8
 #define GUI_DISP_WAVEFORM_X 2
 #define GUI_DISP_WAVEFORM_Y 13
+#define GUI_DISP_WAVEFORM_WIDTH 2
 #define GUI_DISP_OUTPUT_X 2
 #define GUI_DISP_OUTPUT_Y 16
 
+/* Coordinates of items on sweep screen */
+#define GUI_DISP_SWEEP_START_X 1
+#define GUI_DISP_SWEEP_START_END_Y 7
+#define GUI_DISP_SWEEP_STOP_X 1
+#define GUI_DISP_SWEEP_STOP_END_Y 15
+#define GUI_DISP_SWEEP_SCALE_X 2
+#define GUI_DISP_SWEEP_SCALE_Y 1
+#define GUI_DISP_SWEEP_DIRECTION_X 2
+#define GUI_DISP_SWEEP_DIRECTION_Y 5
+#define GUI_DISP_SWEEP_DWELL_X 2
+#define GUI_DISP_SWEEP_DWELL_END_Y 13
+
+#define GUI_SWEEP_DWELL_DIGITS_NUM 5
+#define GUI_SWEEP_DWELL_MAX_VALUE UINT16_MAX
+
+/* Sweep parameters are not persisted, these are used after each power-up */
+#define GUI_SWEEP_DEFAULT_START 100 // Hz
+#define GUI_SWEEP_DEFAULT_STOP 10000 // Hz
+#define GUI_SWEEP_DEFAULT_DWELL 1000 // us
+#define GUI_SWEEP_DEFAULT_SCALE DDS_SWEEP_LOG
+#define GUI_SWEEP_DEFAULT_DIRECTION DDS_SWEEP_UP
+
 #define GUI_SETTING_TIMEOUT_MS 5000
 
 typedef enum
 {
-	GUI_SINE_WAVE_CHAR_1 = HD44780_CUSTOM_GLYPH_0,
+	GUI_SINE_WAVE_CHAR_1 = 0,
 	GUI_SINE_WAVE_CHAR_2,
 	GUI_TRIANGLE_WAVE_CHAR_1,
 	GUI_TRIANGLE_WAVE_CHAR_2,
@@ -60,24 +86,35 @@ typedef enum
 	GUI_SET_MODE_OFF,
 	GUI_SET_FREQUENCY,
 	GUI_SET_AMPLITUDE,
-	GUI_SET_WAVEFORM
+	GUI_SET_WAVEFORM,
+	GUI_SET_SWEEP_START,
+	GUI_SET_SWEEP_STOP,
+	GUI_SET_SWEEP_SCALE,
+	GUI_SET_SWEEP_DIRECTION,
+	GUI_SET_SWEEP_DWELL
 } gui_state_t;
 
 typedef enum
 {
-	GUI_REDRAW_PARTIAL,
-	GUI_REDRAW_FULL
-} gui_redraw_mode_t;
+	GUI_SCREEN_MAIN,
+	GUI_SCREEN_SWEEP
+} gui_screen_t;
 
 typedef struct
 {
 	uint32_t frequency;
 	uint32_t amplitude;
 	gui_state_t state;
+	gui_screen_t screen;
 	uint8_t selected_digit; // 0 - least significant
 	dds_mode_t waveform;
 	bool output_enabled;
 	uint32_t last_activity_tick;
+	uint32_t sweep_start;
+	uint32_t sweep_stop;
+	uint32_t sweep_dwell;
+	dds_sweep_scale_t sweep_scale;
+	dds_sweep_direction_t sweep_direction;
 } gui_ctx_t;
 
 static gui_ctx_t ctx;
@@ -94,47 +131,46 @@ static const uint8_t waveform_chars[GUI_WAVEFORM_CHARS_COUNT][HD44780_CGRAM_CHAR
 		{0x00, 0x0E, 0x1F, 0x1F, 0x1F, 0x0E, 0x00, 0x00}
 };
 
+static const char *const sweep_scale_names[DDS_SWEEP_SCALE_COUNT] =
+{
+		[DDS_SWEEP_LINEAR] = "Lin",
+		[DDS_SWEEP_LOG] = "Log"
+};
+
+static const char *const sweep_direction_names[DDS_SWEEP_DIRECTION_COUNT] =
+{
+		[DDS_SWEEP_UP] = "Up ",
+		[DDS_SWEEP_DOWN] = "Dn ",
+		[DDS_SWEEP_TRIANGLE] = "Tri"
+};
+
 static void gui_load_custom_chars(void)
 {
-	for (size_t i = GUI_SINE_WAVE_CHAR_1; i < GUI_WAVEFORM_CHARS_COUNT; ++i) {
-		hd44780_load_custom_glyph(waveform_chars[i], i);
-	}
+	/* Glyphs get loaded to CGRAM once shown */
+	hd44780_glyphs_register(waveform_chars, GUI_WAVEFORM_CHARS_COUNT);
 
 	hd44780_clear();
 }
 
-static void gui_display_frequency(bool show_zeros)
+static size_t gui_display_frequency(bool show_zeros)
 {
-	bool leading_zeros_end = false;
-
-	for (size_t i = 0; i < GUI_FREQ_DIGITS_NUM; ++i) {
-		const uint32_t divisor = utils_powu(10, GUI_FREQ_LAST_DIGIT_INDEX - i);
-		const uint8_t digit = (ctx.frequency / divisor) % 10;
+	char buffer[UTILS_DEC_STR_SIZE(GUI_FREQ_DIGITS_NUM)];
 
-		/* First non-zero digit found, stop omitting zeros */
-		if (digit != 0) {
-			leading_zeros_end = true;
-		}
-
-		/* Display the digit if it's the last one, or showing leading zeros is enabled, or if there's no more leading zeros */
-		if ((divisor == 1) || show_zeros || leading_zeros_end) {
-			hd44780_write_char(digit + '0');
-		}
+	/* Comma separators are shown only if there are any preceding digits */
+	const size_t length = utils_format_decimal(buffer, ctx.frequency, GUI_FREQ_DIGITS_NUM, show_zeros, ',');
+	hd44780_write_string(buffer);
 
-		/* Display comma separators, but only if there are any preceding digits */
-		if (((i == GUI_FREQ_COMMA_1_POS) || (i == GUI_FREQ_COMMA_2_POS)) && (show_zeros || leading_zeros_end)) {
-			hd44780_write_char(',');
-		}
-	}
+	return length;
 }
 
 static void gui_display_amplitude(void)
 {
-	for (size_t i = 0; i < GUI_AMPL_DIGITS_NUM; ++i) {
-		const uint32_t divisor = utils_powu(10, GUI_AMPL_LAST_DIGIT_INDEX - i);
-		const uint8_t digit = (ctx.amplitude / divisor) % 10;
+	uint8_t digits[GUI_AMPL_DIGITS_NUM];
+
+	utils_to_decimal(ctx.amplitude, digits, GUI_AMPL_DIGITS_NUM);
 
-		hd44780_write_char(digit + '0');
+	for (size_t i = 0; i < GUI_AMPL_DIGITS_NUM; ++i) {
+		hd44780_write_char(digits[i] + '0');
 
 		/* Display decimal point */
 		if (i == GUI_AMPL_DP_POS) {
@@ -149,64 +185,129 @@ static void gui_display_waveform(void)
 
 	switch (ctx.waveform) {
 		case DDS_MODE_SINE:
-			hd44780_write_char(GUI_SINE_WAVE_CHAR_1);
-			hd44780_write_char(GUI_SINE_WAVE_CHAR_2);
+			hd44780_write_glyph(GUI_SINE_WAVE_CHAR_1);
+			hd44780_write_glyph(GUI_SINE_WAVE_CHAR_2);
 			break;
 		case DDS_MODE_TRIANGLE:
-			hd44780_write_char(GUI_TRIANGLE_WAVE_CHAR_1);
-			hd44780_write_char(GUI_TRIANGLE_WAVE_CHAR_2);
+			hd44780_write_glyph(GUI_TRIANGLE_WAVE_CHAR_1);
+			hd44780_write_glyph(GUI_TRIANGLE_WAVE_CHAR_2);
 			break;
 		case DDS_MODE_HALF_SQUARE:
 		case DDS_MODE_SQUARE:
-			hd44780_write_char(GUI_SQUARE_WAVE_CHAR_1);
-			hd44780_write_char(GUI_SQUARE_WAVE_CHAR_2);
+			hd44780_write_glyph(GUI_SQUARE_WAVE_CHAR_1);
+			hd44780_write_glyph(GUI_SQUARE_WAVE_CHAR_2);
 			break;
 		default:
 			break;
 	}
+
+	/* Blank the gap up to output state */
+	hd44780_write_padded("", GUI_DISP_OUTPUT_Y - GUI_DISP_WAVEFORM_Y - GUI_DISP_WAVEFORM_WIDTH);
 }
 
 static void gui_display_output_state(void)
 {
 	hd44780_gotoxy(GUI_DISP_OUTPUT_X, GUI_DISP_OUTPUT_Y);
-	hd44780_write_char(ctx.output_enabled ? GUI_OUTPUT_ON_CHAR : GUI_OUTPUT_OFF_CHAR);
+	hd44780_write_glyph(ctx.output_enabled ? GUI_OUTPUT_ON_CHAR : GUI_OUTPUT_OFF_CHAR);
 }
 
 static bool gui_increment_value(uint32_t *value, int32_t increment, uint8_t selected_digit, uint32_t limit_lo, uint32_t limit_hi)
 {
-	const uint32_t multiplier = utils_powu(10, selected_digit);
-	const uint32_t new_value = *value + increment * multiplier;
+	const uint32_t multiplier = utils_pow10(selected_digit);
+	uint32_t steps = (increment > 0) ? increment : -increment;
+	uint32_t room;
 
-	if ((new_value < limit_lo) || (new_value > limit_hi)) {
+	if (increment > 0) {
+		room = (*value < limit_hi) ? (limit_hi - *value) : 0;
+	}
+	else {
+		room = (*value > limit_lo) ? (*value - limit_lo) : 0;
+	}
+
+	/* Accelerated increment is cut down to whole steps that still fit, keeping other digits intact */
+	if (steps > (room / multiplier)) {
+		steps = room / multiplier;
+	}
+	if (steps == 0) {
 		return false;
 	}
 
-	*value = new_value;
+	if (increment > 0) {
+		*value += steps * multiplier;
+	}
+	else {
+		*value -= steps * multiplier;
+	}
 
 	return true;
 }
 
-static void gui_redraw_display(uint8_t cursor_x, uint8_t cursor_y, gui_redraw_mode_t mode)
+static void gui_redraw_sweep(void)
 {
 	const bool set_mode_active = (ctx.state != GUI_SET_MODE_OFF);
 
-	/* Draw upper row */
-	if (mode == GUI_REDRAW_PARTIAL) {
-		hd44780_gotoxy(1, 1); // Go to the beginning of the upper row
+	/* Draw upper row, every cell is overwritten so no clear is needed */
+	hd44780_gotoxy(1, 1);
+	hd44780_show_cursor(set_mode_active);
+	hd44780_write_integer(ctx.sweep_start, GUI_FREQ_DIGITS_NUM);
+	hd44780_write_char('-');
+	hd44780_write_integer(ctx.sweep_stop, GUI_FREQ_DIGITS_NUM);
+	hd44780_write_glyph(dds_sweep_is_running() ? GUI_OUTPUT_ON_CHAR : GUI_OUTPUT_OFF_CHAR);
+
+	/* Draw lower row */
+	hd44780_gotoxy(2, 1);
+	hd44780_write_string(sweep_scale_names[ctx.sweep_scale]);
+	hd44780_write_char(' ');
+	hd44780_write_string(sweep_direction_names[ctx.sweep_direction]);
+	hd44780_write_char(' ');
+	hd44780_write_integer(ctx.sweep_dwell, GUI_SWEEP_DWELL_DIGITS_NUM);
+	hd44780_write_padded("us", GUI_DISP_RESOLUTION_Y - GUI_DISP_SWEEP_DWELL_END_Y);
+
+	/* Place the cursor on the field being edited */
+	switch (ctx.state) {
+		case GUI_SET_SWEEP_START:
+			hd44780_gotoxy(GUI_DISP_SWEEP_START_X, GUI_DISP_SWEEP_START_END_Y - ctx.selected_digit);
+			break;
+		case GUI_SET_SWEEP_STOP:
+			hd44780_gotoxy(GUI_DISP_SWEEP_STOP_X, GUI_DISP_SWEEP_STOP_END_Y - ctx.selected_digit);
+			break;
+		case GUI_SET_SWEEP_SCALE:
+			hd44780_gotoxy(GUI_DISP_SWEEP_SCALE_X, GUI_DISP_SWEEP_SCALE_Y);
+			break;
+		case GUI_SET_SWEEP_DIRECTION:
+			hd44780_gotoxy(GUI_DISP_SWEEP_DIRECTION_X, GUI_DISP_SWEEP_DIRECTION_Y);
+			break;
+		case GUI_SET_SWEEP_DWELL:
+			hd44780_gotoxy(GUI_DISP_SWEEP_DWELL_X, GUI_DISP_SWEEP_DWELL_END_Y - ctx.selected_digit);
+			break;
+		default:
+			break;
 	}
-	else {
-		hd44780_clear();
+}
+
+static void gui_redraw_display(uint8_t cursor_x, uint8_t cursor_y)
+{
+	const bool set_mode_active = (ctx.state != GUI_SET_MODE_OFF);
+
+	/* Sweep screen knows its cursor positions by itself */
+	if (ctx.screen == GUI_SCREEN_SWEEP) {
+		gui_redraw_sweep();
+		hd44780_flush();
+		return;
 	}
+
+	/* Draw upper row, every cell is overwritten so no clear is needed */
+	hd44780_gotoxy(1, 1); // Go to the beginning of the upper row
 	hd44780_show_cursor(set_mode_active);
-	hd44780_write_string("Freq:");
-	gui_display_frequency(set_mode_active);
-	hd44780_write_string("Hz");
+	hd44780_write_string(GUI_FREQ_LABEL);
+	const size_t freq_length = gui_display_frequency(set_mode_active);
+	hd44780_write_padded("Hz", GUI_DISP_RESOLUTION_Y - strlen(GUI_FREQ_LABEL) - freq_length);
 
 	/* Draw lower row */
 	hd44780_gotoxy(2, 1);  // Go to the beginning of the lower row
 	hd44780_write_string("Ampl:");
 	gui_display_amplitude();
-	hd44780_write_string("Vp");
+	hd44780_write_padded("Vp", GUI_DISP_WAVEFORM_Y - GUI_DISP_AMPL_END_Y - 1);
 	gui_display_waveform();
 	gui_display_output_state();
 
@@ -214,6 +315,9 @@ static void gui_redraw_display(uint8_t cursor_x, uint8_t cursor_y, gui_redraw_mo
 	if (set_mode_active) {
 		hd44780_gotoxy(cursor_x, cursor_y);
 	}
+
+	/* Send only what has changed */
+	hd44780_flush();
 }
 
 static uint8_t gui_frequency_digit_to_column(uint8_t digit_index)
@@ -280,12 +384,14 @@ static int gui_store_settings(void)
 		return err;
 	}
 
+	/* Written back to flash later by settings_task() in a single record, so all three entries
+	 * land there together. Unchanged entries are skipped. */
 	return 0;
 }
 
-static int gui_configure_dds(void)
+static int gui_stage_dds_config(void)
 {
-	int err = dds_set_frequency(ctx.frequency, DDS_CH0);
+	int err = dds_shadow_set_frequency_hz(ctx.frequency);
 	if (err) {
 		return err;
 	}
@@ -308,6 +414,154 @@ static int gui_configure_dds(void)
 	return 0;
 }
 
+static int gui_configure_dds(void)
+{
+	/* Collect all changes and let the driver write only what has changed */
+	int err = dds_begin();
+	if (err) {
+		return err;
+	}
+
+	err = gui_stage_dds_config();
+	const int commit_err = dds_commit();
+
+	return err ? err : commit_err;
+}
+
+static int gui_toggle_sweep(void)
+{
+	int err;
+
+	if (dds_sweep_is_running()) {
+		err = dds_sweep_stop();
+		if (err) {
+			return err;
+		}
+
+		/* Restore the regular output configuration */
+		ctx.output_enabled = false;
+		return gui_configure_dds();
+	}
+
+	const dds_sweep_config_t config = {
+		.start_freq = ctx.sweep_start,
+		.stop_freq = ctx.sweep_stop,
+		.points = DDS_SWEEP_MAX_POINTS,
+		.dwell_us = ctx.sweep_dwell,
+		.scale = ctx.sweep_scale,
+		.direction = ctx.sweep_direction
+	};
+
+	/* Output has to be enabled before the sweep starts, the DDS belongs to the sweep timer from then on */
+	ctx.output_enabled = true;
+	err = dds_set_output_enable(ctx.output_enabled);
+	if (err) {
+		return err;
+	}
+
+	return dds_sweep_start(&config);
+}
+
+/* Moves to the next digit on click, to the next field on hold or after the last digit */
+static void gui_advance_digit(encoder_button_action_t type, uint8_t digits_num, gui_state_t next_state)
+{
+	if (type == ENCODER_BUTTON_CLICK) {
+		++ctx.selected_digit;
+		if (ctx.selected_digit < digits_num) {
+			return;
+		}
+	}
+
+	ctx.selected_digit = 0;
+	ctx.state = next_state;
+}
+
+static void gui_sweep_button_callback(encoder_button_action_t type)
+{
+	int err;
+
+	switch (ctx.state) {
+		case GUI_SET_MODE_OFF:
+			if (type == ENCODER_BUTTON_CLICK) {
+				err = gui_toggle_sweep();
+				if (err) {
+					error_handler_message("Sweep fail");
+				}
+			}
+			else {
+				ctx.selected_digit = 0;
+				ctx.state = GUI_SET_SWEEP_START;
+			}
+			break;
+
+		case GUI_SET_SWEEP_START:
+			gui_advance_digit(type, GUI_FREQ_DIGITS_NUM, GUI_SET_SWEEP_STOP);
+			break;
+
+		case GUI_SET_SWEEP_STOP:
+			gui_advance_digit(type, GUI_FREQ_DIGITS_NUM, GUI_SET_SWEEP_SCALE);
+			break;
+
+		case GUI_SET_SWEEP_SCALE:
+			ctx.state = GUI_SET_SWEEP_DIRECTION;
+			break;
+
+		case GUI_SET_SWEEP_DIRECTION:
+			ctx.state = GUI_SET_SWEEP_DWELL;
+			break;
+
+		case GUI_SET_SWEEP_DWELL:
+			gui_advance_digit(type, GUI_SWEEP_DWELL_DIGITS_NUM, GUI_SET_MODE_OFF);
+
+			/* Apply new parameters to the running sweep */
+			if ((ctx.state == GUI_SET_MODE_OFF) && dds_sweep_is_running()) {
+				err = gui_toggle_sweep();
+				if (!err) {
+					err = gui_toggle_sweep();
+				}
+				if (err) {
+					error_handler_message("Sweep fail");
+				}
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	gui_redraw_display(0, 0);
+}
+
+static void gui_sweep_rotation_callback(int32_t increment, int32_t accel_increment)
+{
+	switch (ctx.state) {
+		case GUI_SET_SWEEP_START:
+			gui_increment_value(&ctx.sweep_start, accel_increment, ctx.selected_digit, GUI_FREQ_MIN_VALUE, GUI_FREQ_MAX_VALUE);
+			break;
+
+		case GUI_SET_SWEEP_STOP:
+			gui_increment_value(&ctx.sweep_stop, accel_increment, ctx.selected_digit, GUI_FREQ_MIN_VALUE, GUI_FREQ_MAX_VALUE);
+			break;
+
+		case GUI_SET_SWEEP_SCALE:
+			ctx.sweep_scale = UTILS_CLAMP(ctx.sweep_scale + increment, DDS_SWEEP_LINEAR, DDS_SWEEP_LOG);
+			break;
+
+		case GUI_SET_SWEEP_DIRECTION:
+			ctx.sweep_direction = UTILS_CLAMP(ctx.sweep_direction + increment, DDS_SWEEP_UP, DDS_SWEEP_TRIANGLE);
+			break;
+
+		case GUI_SET_SWEEP_DWELL:
+			gui_increment_value(&ctx.sweep_dwell, accel_increment, ctx.selected_digit, DDS_SWEEP_MIN_DWELL_US, GUI_SWEEP_DWELL_MAX_VALUE);
+			break;
+
+		default:
+			break;
+	}
+
+	gui_redraw_display(0, 0);
+}
+
 static int gui_handle_setting_timeout(void)
 {
 	if (ctx.state == GUI_SET_MODE_OFF) {
@@ -318,14 +572,20 @@ static int gui_handle_setting_timeout(void)
 		return 0;
 	}
 
-	/* Disable setting mode and roll back all changes */
+	/* Sweep parameters are not persisted, just leave setting mode keeping the changes */
 	ctx.state = GUI_SET_MODE_OFF;
+	if (ctx.screen == GUI_SCREEN_SWEEP) {
+		gui_redraw_display(0, 0);
+		return 0;
+	}
+
+	/* Disable setting mode and roll back all changes */
 	const int err = gui_load_settings();
 	if (err) {
 		return err;
 	}
 
-	gui_redraw_display(0, 0, GUI_REDRAW_FULL);
+	gui_redraw_display(0, 0);
 
 	return 0;
 }
@@ -336,6 +596,11 @@ static void gui_button_callback(encoder_button_action_t type)
 
 	ctx.last_activity_tick = delay_get_ticks();
 
+	if (ctx.screen == GUI_SCREEN_SWEEP) {
+		gui_sweep_button_callback(type);
+		return;
+	}
+
 	switch (ctx.state) {
 		case GUI_SET_MODE_OFF:
 			if (type == ENCODER_BUTTON_CLICK) {
@@ -344,12 +609,12 @@ static void gui_button_callback(encoder_button_action_t type)
 				if (err) {
 					error_handler_message("DDS enable fail");
 				}
-				gui_redraw_display(0, 0, GUI_REDRAW_PARTIAL);
+				gui_redraw_display(0, 0);
 			}
 			else {
 				ctx.selected_digit = 0;
 				ctx.state = GUI_SET_FREQUENCY;
-				gui_redraw_display(GUI_DISP_FREQ_X, gui_frequency_digit_to_column(ctx.selected_digit), GUI_REDRAW_PARTIAL);
+				gui_redraw_display(GUI_DISP_FREQ_X, gui_frequency_digit_to_column(ctx.selected_digit));
 			}
 			break;
 
@@ -357,18 +622,18 @@ static void gui_button_callback(encoder_button_action_t type)
 			if (type == ENCODER_BUTTON_CLICK) {
 				++ctx.selected_digit;
 				if (ctx.selected_digit < GUI_FREQ_DIGITS_NUM) {
-					gui_redraw_display(GUI_DISP_FREQ_X, gui_frequency_digit_to_column(ctx.selected_digit), GUI_REDRAW_PARTIAL);
+					gui_redraw_display(GUI_DISP_FREQ_X, gui_frequency_digit_to_column(ctx.selected_digit));
 				}
 				else {
 					ctx.selected_digit = 0;
 					ctx.state = GUI_SET_AMPLITUDE;
-					gui_redraw_display(GUI_DISP_AMPL_X, gui_amplitude_digit_to_column(ctx.selected_digit), GUI_REDRAW_PARTIAL);
+					gui_redraw_display(GUI_DISP_AMPL_X, gui_amplitude_digit_to_column(ctx.selected_digit));
 				}
 			}
 			else {
 				ctx.selected_digit = 0;
 				ctx.state = GUI_SET_AMPLITUDE;
-				gui_redraw_display(GUI_DISP_AMPL_X, gui_amplitude_digit_to_column(ctx.selected_digit), GUI_REDRAW_PARTIAL);
+				gui_redraw_display(GUI_DISP_AMPL_X, gui_amplitude_digit_to_column(ctx.selected_digit));
 			}
 			break;
 
@@ -376,16 +641,16 @@ static void gui_button_callback(encoder_button_action_t type)
 			if (type == ENCODER_BUTTON_CLICK) {
 				++ctx.selected_digit;
 				if (ctx.selected_digit < GUI_AMPL_DIGITS_NUM) {
-					gui_redraw_display(GUI_DISP_AMPL_X, gui_amplitude_digit_to_column(ctx.selected_digit), GUI_REDRAW_PARTIAL);
+					gui_redraw_display(GUI_DISP_AMPL_X, gui_amplitude_digit_to_column(ctx.selected_digit));
 				}
 				else {
 					ctx.state = GUI_SET_WAVEFORM;
-					gui_redraw_display(GUI_DISP_WAVEFORM_X, GUI_DISP_WAVEFORM_Y, GUI_REDRAW_PARTIAL);
+					gui_redraw_display(GUI_DISP_WAVEFORM_X, GUI_DISP_WAVEFORM_Y);
 				}
 			}
 			else {
 				ctx.state = GUI_SET_WAVEFORM;
-				gui_redraw_display(GUI_DISP_WAVEFORM_X, GUI_DISP_WAVEFORM_Y, GUI_REDRAW_PARTIAL);
+				gui_redraw_display(GUI_DISP_WAVEFORM_X, GUI_DISP_WAVEFORM_Y);
 			}
 			break;
 
@@ -405,7 +670,7 @@ static void gui_button_callback(encoder_button_action_t type)
 			if (err) {
 				error_handler_message("DDS config fail");
 			}
-			gui_redraw_display(0, 0, GUI_REDRAW_FULL);
+			gui_redraw_display(0, 0);
 			break;
 
 		default:
@@ -413,7 +678,7 @@ static void gui_button_callback(encoder_button_action_t type)
 	}
 }
 
-static void gui_rotation_callback(encoder_direction_t direction, uint32_t count, int32_t increment)
+static void gui_rotation_callback(encoder_direction_t direction, uint32_t count, int32_t increment, int32_t accel_increment)
 {
 	/* Prevent changing values accidentally when moving to next field */
 	if (!encoder_button_is_idle()) {
@@ -422,28 +687,38 @@ static void gui_rotation_callback(encoder_direction_t direction, uint32_t count,
 
 	ctx.last_activity_tick = delay_get_ticks();
 
-	switch (ctx.state) {
-		case GUI_SET_MODE_OFF:
-			// Do nothing
-			break;
+	/* Rotating outside of setting mode switches screens, unless the sweep is in progress */
+	if (ctx.state == GUI_SET_MODE_OFF) {
+		if (!dds_sweep_is_running()) {
+			ctx.screen = (ctx.screen == GUI_SCREEN_MAIN) ? GUI_SCREEN_SWEEP : GUI_SCREEN_MAIN;
+			gui_redraw_display(0, 0);
+		}
+		return;
+	}
 
+	if (ctx.screen == GUI_SCREEN_SWEEP) {
+		gui_sweep_rotation_callback(increment, accel_increment);
+		return;
+	}
+
+	switch (ctx.state) {
 		case GUI_SET_FREQUENCY:
-			if (gui_increment_value(&ctx.frequency, increment, ctx.selected_digit, GUI_FREQ_MIN_VALUE, GUI_FREQ_MAX_VALUE)) {
-				gui_redraw_display(GUI_DISP_FREQ_X, gui_frequency_digit_to_column(ctx.selected_digit), GUI_REDRAW_PARTIAL);
+			if (gui_increment_value(&ctx.frequency, accel_increment, ctx.selected_digit, GUI_FREQ_MIN_VALUE, GUI_FREQ_MAX_VALUE)) {
+				gui_redraw_display(GUI_DISP_FREQ_X, gui_frequency_digit_to_column(ctx.selected_digit));
 			}
 			break;
 
 		case GUI_SET_AMPLITUDE: {
 			const uint32_t max_amplitude = (ctx.waveform == DDS_MODE_SQUARE) ? GUI_AMPL_MAX_VALUE_SQUARE : GUI_AMPL_MAX_VALUE;
-			if (gui_increment_value(&ctx.amplitude, increment, ctx.selected_digit, GUI_AMPL_MIN_VALUE, max_amplitude)) {
-				gui_redraw_display(GUI_DISP_AMPL_X, gui_amplitude_digit_to_column(ctx.selected_digit), GUI_REDRAW_PARTIAL);
+			if (gui_increment_value(&ctx.amplitude, accel_increment, ctx.selected_digit, GUI_AMPL_MIN_VALUE, max_amplitude)) {
+				gui_redraw_display(GUI_DISP_AMPL_X, gui_amplitude_digit_to_column(ctx.selected_digit));
 			}
 			break;
 		}
 
 		case GUI_SET_WAVEFORM:
 			ctx.waveform = UTILS_CLAMP(ctx.waveform + increment, DDS_MODE_SINE, DDS_MODE_SQUARE);
-			gui_redraw_display(GUI_DISP_WAVEFORM_X, GUI_DISP_WAVEFORM_Y, GUI_REDRAW_PARTIAL);
+			gui_redraw_display(GUI_DISP_WAVEFORM_X, GUI_DISP_WAVEFORM_Y);
 			break;
 
 		default:
@@ -464,29 +739,47 @@ int gui_init(void)
 		return err;
 	}
 	ctx.state = GUI_SET_MODE_OFF;
+	ctx.screen = GUI_SCREEN_MAIN;
 	ctx.output_enabled = false;
 
+	ctx.sweep_start = GUI_SWEEP_DEFAULT_START;
+	ctx.sweep_stop = GUI_SWEEP_DEFAULT_STOP;
+	ctx.sweep_dwell = GUI_SWEEP_DEFAULT_DWELL;
+	ctx.sweep_scale = GUI_SWEEP_DEFAULT_SCALE;
+	ctx.sweep_direction = GUI_SWEEP_DEFAULT_DIRECTION;
+
 	err = gui_configure_dds();
 	if (err) {
 		return err;
 	}
 
-	gui_redraw_display(0, 0, GUI_REDRAW_FULL);
+	gui_redraw_display(0, 0);
 
 	return 0;
 }
 
 bool gui_is_idle(void)
 {
-	return (ctx.state == GUI_SET_MODE_OFF) && encoder_button_is_idle();
+	return !encoder_has_events();
+}
+
+bool gui_needs_tick(void)
+{
+	/* Setting mode times out, changed settings wait for write-back */
+	return (ctx.state != GUI_SET_MODE_OFF) || settings_is_dirty() || encoder_needs_tick();
 }
 
 void gui_task(void)
 {
 	encoder_task();
 
-	const int err = gui_handle_setting_timeout();
+	int err = gui_handle_setting_timeout();
 	if (err) {
 		error_handler_message("NVS read fail");
 	}
+
+	err = settings_task();
+	if (err) {
+		error_handler_message("NVS store fail");
+	}
 }
@@ -4,6 +4,9 @@
 
 int gui_init(void);
 
+/* Nothing to handle until the next interrupt */
 bool gui_is_idle(void);
+/* Timeouts are pending, SysTick has to keep running while sleeping */
+bool gui_needs_tick(void);
 
 void gui_task(void);
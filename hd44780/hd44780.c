@@ -7,10 +7,21 @@
 
 #include "hd44780.h"
 #include <string.h>
-#include <stdlib.h>
+#include <utils.h>
 
 /* Needed in HD44780_write_integer() */
-#define HD44780_TMP_BUF_SIZE 11 // Value stored in int32_t has at most 10 digits - 2147483647 - one additional byte for null-terminator
+#define HD44780_TMP_BUF_SIZE UTILS_DEC_STR_SIZE(UTILS_DEC_MAX_DIGITS)
+
+#define HD44780_FB_SIZE 80 // Largest supported displays have 80 cells - 20x4 and 40x2
+#define HD44780_FB_DIRTY_SIZE ((HD44780_FB_SIZE + 7) / 8)
+#define HD44780_ADDR_UNKNOWN 0xFF
+
+#define HD44780_EXEC_TIME_US 50 // At least 37us (HD44780 datasheet, Table 6, p. 24)
+#define HD44780_CLEAR_EXEC_TIME_US 1600 // At least 1.52ms (HD44780 datasheet, Table 6, p. 24)
+#define HD44780_BUSY_POLL_MIN_US 2 // Each poll takes two E pulses, at least 1us each
+
+#define HD44780_GLYPH_NONE UINT16_MAX
+#define HD44780_GLYPH_FALLBACK_CHAR ' ' // Shown if all slots are in use by visible cells
 
 typedef struct
 {
@@ -31,23 +42,177 @@ static const hd44780_type_data_t hd44780_type_data[HD44780_DISPLAY_TYPES_NUM] =
 		{.rows = 2, .columns = 40, .rows_first_addr[0] = 0x00, .rows_first_addr[1] = 0x40},
 };
 
+typedef struct
+{
+	char cells[HD44780_FB_SIZE];
+	uint8_t dirty[HD44780_FB_DIRTY_SIZE]; // Cells differing from DDRAM contents
+	size_t cursor_row; // Indexed from 0, unlike hd44780_gotoxy() arguments
+	size_t cursor_col;
+	bool cursor_shown;
+	uint8_t hw_addr; // Current DDRAM address counter value, if known
+} hd44780_fb_t;
+
+typedef struct
+{
+	uint16_t glyph_id; // Logical glyph held by the slot
+	uint16_t last_used; // LRU stamp
+	uint8_t refs; // Visible cells (in framebuffer) showing the slot
+	bool pending_load; // Assigned, but not yet written to CGRAM
+} hd44780_glyph_slot_t;
+
+typedef struct
+{
+	const uint8_t (*glyphs)[HD44780_CGRAM_CHAR_SIZE];
+	size_t count;
+	uint16_t clock; // Incremented on each use, source of LRU stamps
+	hd44780_glyph_slot_t slots[HD44780_CUSTOM_GLYPHS_NUM];
+} hd44780_glyph_manager_t;
+
+typedef struct
+{
+	bool ready; // Busy flag can be read only once in 4-bit mode
+	bool measure;
+	hd44780_busy_stats_t stats;
+} hd44780_busy_t;
+
 static const hd44780_config_t* hd44780_config = NULL;
+static hd44780_fb_t hd44780_fb;
+static hd44780_busy_t hd44780_busy;
+static hd44780_glyph_manager_t hd44780_glyphs;
+
+static bool hd44780_send(uint8_t byte, hd44780_mode_t mode, uint16_t exec_us);
+
+static const hd44780_type_data_t *hd44780_get_type_data(void)
+{
+	return &hd44780_type_data[hd44780_config->type];
+}
+
+static bool hd44780_fb_is_dirty(size_t index)
+{
+	return (hd44780_fb.dirty[index / 8] & (1 << (index % 8))) != 0;
+}
+
+static void hd44780_fb_set_dirty(size_t index, bool dirty)
+{
+	if (dirty) {
+		hd44780_fb.dirty[index / 8] |= (1 << (index % 8));
+	}
+	else {
+		hd44780_fb.dirty[index / 8] &= ~(1 << (index % 8));
+	}
+}
+
+/* Character codes below HD44780_CUSTOM_GLYPHS_NUM refer to CGRAM slots */
+static void hd44780_fb_set_cell(size_t index, char character)
+{
+	const uint8_t old_code = hd44780_fb.cells[index];
+	const uint8_t new_code = character;
+
+	if (old_code == new_code) {
+		return;
+	}
+
+	if (old_code < HD44780_CUSTOM_GLYPHS_NUM) {
+		--hd44780_glyphs.slots[old_code].refs;
+	}
+	if (new_code < HD44780_CUSTOM_GLYPHS_NUM) {
+		++hd44780_glyphs.slots[new_code].refs;
+	}
+
+	hd44780_fb.cells[index] = character;
+	hd44780_fb_set_dirty(index, true);
+}
+
+/* Display contents can't be trusted after a dropped byte, everything gets sent again on flush */
+static void hd44780_fb_invalidate(void)
+{
+	const hd44780_type_data_t *type_data = hd44780_get_type_data();
+	const size_t cells = type_data->rows * type_data->columns;
+
+	for (size_t i = 0; i < cells; ++i) {
+		hd44780_fb_set_dirty(i, true);
+	}
+	for (size_t i = 0; i < HD44780_CUSTOM_GLYPHS_NUM; ++i) {
+		if (hd44780_glyphs.slots[i].glyph_id != HD44780_GLYPH_NONE) {
+			hd44780_glyphs.slots[i].pending_load = true;
+		}
+	}
+	hd44780_fb.hw_addr = HD44780_ADDR_UNKNOWN;
+}
+
+static bool hd44780_set_hw_addr(uint8_t address)
+{
+	if (hd44780_fb.hw_addr == address) {
+		return true;
+	}
+
+	if (!hd44780_send(HD44780_SET_DDRAM_ADDR_CMD | address, HD44780_INSTRUCTION, HD44780_EXEC_TIME_US)) {
+		return false;
+	}
+	hd44780_fb.hw_addr = address;
+
+	return true;
+}
+
+static bool hd44780_load_cgram(const uint8_t *glyph_array, hd44780_glyph_addr_t cgram_addr)
+{
+	/* Set CGRAM pointer to required location, address counter doesn't point to DDRAM anymore */
+	const size_t cgram_offset = cgram_addr * HD44780_CGRAM_CHAR_SIZE;
+	hd44780_fb.hw_addr = HD44780_ADDR_UNKNOWN;
+	if (!hd44780_send(HD44780_SET_CGRAM_ADDR_CMD | cgram_offset, HD44780_INSTRUCTION, HD44780_EXEC_TIME_US)) {
+		return false;
+	}
+
+	/* Load character */
+	for (size_t i = 0; i < HD44780_CGRAM_CHAR_SIZE; i++) {
+		if (!hd44780_send(glyph_array[i], HD44780_CHARACTER, HD44780_EXEC_TIME_US)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void hd44780_clear_hw(void)
+{
+	/* Framebuffer matches DDRAM contents once the display is cleared */
+	memset(hd44780_fb.cells, ' ', sizeof(hd44780_fb.cells));
+	memset(hd44780_fb.dirty, 0, sizeof(hd44780_fb.dirty));
+	for (size_t i = 0; i < HD44780_CUSTOM_GLYPHS_NUM; ++i) {
+		hd44780_glyphs.slots[i].refs = 0;
+	}
+	hd44780_fb.cursor_row = 0;
+	hd44780_fb.cursor_col = 0;
+	hd44780_fb.hw_addr = HD44780_ADDR_UNKNOWN;
+
+	/* Clear display, if that fails the blank framebuffer gets sent on flush instead */
+	if (!hd44780_send(HD44780_CLEAR_DISPLAY_CMD, HD44780_INSTRUCTION, HD44780_CLEAR_EXEC_TIME_US)) {
+		return;
+	}
+
+	/* Set cursor to the first column of the first row */
+	hd44780_set_hw_addr(hd44780_get_type_data()->rows_first_addr[0]);
+}
 
 void hd44780_init(const hd44780_config_t *config)
 {
 	hd44780_config = config;
 
+	/* CGRAM contents are unknown */
+	for (size_t i = 0; i < HD44780_CUSTOM_GLYPHS_NUM; ++i) {
+		hd44780_glyphs.slots[i].glyph_id = HD44780_GLYPH_NONE;
+		hd44780_glyphs.slots[i].pending_load = false;
+	}
+
 	/* Sanity check */
 	if ((hd44780_config->type < 0) || (hd44780_config->type >= HD44780_DISPLAY_TYPES_NUM)) {
 		return;
 	}
 
-	hd44780_write_cmd(0x03);
-	hd44780_config->io->delay_us(4500); // Wait for more than 4.1ms (HD44780 datasheet, Fig. 24, p. 46)
-	hd44780_write_cmd(0x03);
-	hd44780_config->io->delay_us(150); // Wait for more than 100us
-	hd44780_write_cmd(0x03);
-	hd44780_config->io->delay_us(100); // Not specified in DS, chosen empirically
+	hd44780_busy.ready = false;
+	hd44780_send(0x03, HD44780_INSTRUCTION, 4500); // Wait for more than 4.1ms (HD44780 datasheet, Fig. 24, p. 46)
+	hd44780_send(0x03, HD44780_INSTRUCTION, 150); // Wait for more than 100us
+	hd44780_send(0x03, HD44780_INSTRUCTION, 100); // Not specified in DS, chosen empirically
 	hd44780_write_cmd(0x02);
 
 	/* Here begins the real configuration */
@@ -59,41 +224,136 @@ void hd44780_init(const hd44780_config_t *config)
 		hd44780_write_cmd(HD44780_FUNCTION_SET_CMD | HD44780_TWO_LINES); // Initialize as 2 lines, 5x8 matrix, 4-bit interface
 	}
 
+	/* Interface is in 4-bit mode now, busy flag can be read */
+	hd44780_busy.ready = true;
+
 	hd44780_write_cmd(HD44780_ENTRY_MODE_SET_CMD | hd44780_config->entry_mode_flags); // Set entry mode flags
 	hd44780_show_cursor(false); // Enable display, hide cursor
 
-	hd44780_clear();
+	hd44780_clear_hw();
 }
 
-void hd44780_write_byte(uint8_t byte, hd44780_mode_t mode)
+static void hd44780_pulse_enable(void)
 {
-	/* Set RS line state */
-	hd44780_config->io->set_pin_state(HD44780_PIN_RS, (mode == HD44780_CHARACTER) ? HD44780_HIGH : HD44780_LOW);
-
-	/* Write upper nibble */
-	hd44780_config->io->set_pin_state(HD44780_PIN_D7, (byte & (1 << 7)) ? HD44780_HIGH : HD44780_LOW);
-	hd44780_config->io->set_pin_state(HD44780_PIN_D6, (byte & (1 << 6)) ? HD44780_HIGH : HD44780_LOW);
-	hd44780_config->io->set_pin_state(HD44780_PIN_D5, (byte & (1 << 5)) ? HD44780_HIGH : HD44780_LOW);
-	hd44780_config->io->set_pin_state(HD44780_PIN_D4, (byte & (1 << 4)) ? HD44780_HIGH : HD44780_LOW);
-
-	/* Pulse enable signal */
 	hd44780_config->io->set_pin_state(HD44780_PIN_E, HD44780_HIGH);
 	hd44780_config->io->delay_us(1); // At least 450ns (HD44780 datasheet, p. 49)
 	hd44780_config->io->set_pin_state(HD44780_PIN_E, HD44780_LOW);
+}
+
+static void hd44780_write_nibble(uint8_t nibble, hd44780_mode_t mode)
+{
+	const hd44780_pin_state_t rs = (mode == HD44780_CHARACTER) ? HD44780_HIGH : HD44780_LOW;
 
-	/* Write lower nibble */
-	hd44780_config->io->set_pin_state(HD44780_PIN_D7, (byte & (1 << 3)) ? HD44780_HIGH : HD44780_LOW);
-	hd44780_config->io->set_pin_state(HD44780_PIN_D6, (byte & (1 << 2)) ? HD44780_HIGH : HD44780_LOW);
-	hd44780_config->io->set_pin_state(HD44780_PIN_D5, (byte & (1 << 1)) ? HD44780_HIGH : HD44780_LOW);
-	hd44780_config->io->set_pin_state(HD44780_PIN_D4, (byte & (1 << 0)) ? HD44780_HIGH : HD44780_LOW);
+	/* Fast path - whole nibble with RS in one go */
+	if (hd44780_config->io->write_nibble != NULL) {
+		hd44780_config->io->write_nibble(rs, nibble);
+	}
+	else {
+		hd44780_config->io->set_pin_state(HD44780_PIN_RS, rs);
+		hd44780_config->io->set_pin_state(HD44780_PIN_D7, (nibble & (1 << 3)) ? HD44780_HIGH : HD44780_LOW);
+		hd44780_config->io->set_pin_state(HD44780_PIN_D6, (nibble & (1 << 2)) ? HD44780_HIGH : HD44780_LOW);
+		hd44780_config->io->set_pin_state(HD44780_PIN_D5, (nibble & (1 << 1)) ? HD44780_HIGH : HD44780_LOW);
+		hd44780_config->io->set_pin_state(HD44780_PIN_D4, (nibble & (1 << 0)) ? HD44780_HIGH : HD44780_LOW);
+	}
 
-	/* Pulse enable signal */
+	hd44780_pulse_enable();
+}
+
+static bool hd44780_busy_flag_available(void)
+{
+	return hd44780_busy.ready && (hd44780_config->io->get_pin_state != NULL) && (hd44780_config->io->set_data_dir != NULL);
+}
+
+static bool hd44780_read_busy_flag(void)
+{
+	/* Busy flag comes as D7 of upper nibble (HD44780 datasheet, Table 6, p. 24) */
 	hd44780_config->io->set_pin_state(HD44780_PIN_E, HD44780_HIGH);
-	hd44780_config->io->delay_us(1);
+	hd44780_config->io->delay_us(1); // Data delay time is at most 360ns (HD44780 datasheet, p. 49)
+	const bool busy = (hd44780_config->io->get_pin_state(HD44780_PIN_D7) == HD44780_HIGH);
 	hd44780_config->io->set_pin_state(HD44780_PIN_E, HD44780_LOW);
 
-	/* Wait at least 37us for command to be executed (HD44780 datasheet, Table 6, p. 24) */
-	hd44780_config->io->delay_us(50);
+	/* Lower nibble of address counter has to be clocked out too, even if not needed */
+	hd44780_pulse_enable();
+
+	return busy;
+}
+
+static void hd44780_update_busy_stats(uint32_t busy_us, bool timeout)
+{
+	hd44780_busy_stats_t *stats = &hd44780_busy.stats;
+	const uint16_t us = (busy_us > UINT16_MAX) ? UINT16_MAX : busy_us;
+
+	if ((stats->count == 0) || (us < stats->min_us)) {
+		stats->min_us = us;
+	}
+	if (us > stats->max_us) {
+		stats->max_us = us;
+	}
+	stats->last_us = us;
+	++stats->count;
+
+	if (timeout) {
+		++stats->timeouts;
+	}
+}
+
+static void hd44780_wait_ready(uint16_t exec_us)
+{
+	if (!hd44780_busy_flag_available()) {
+		hd44780_config->io->delay_us(exec_us);
+		return;
+	}
+
+	const bool measure = hd44780_busy.measure && (hd44780_config->io->get_time_us != NULL);
+	const uint32_t start_us = measure ? hd44780_config->io->get_time_us() : 0;
+
+	hd44780_config->io->set_data_dir(HD44780_DATA_INPUT);
+	hd44780_config->io->set_pin_state(HD44780_PIN_RS, HD44780_LOW);
+	hd44780_config->io->set_pin_state(HD44780_PIN_RW, HD44780_HIGH);
+
+	/* Give up after twice the fixed delay */
+	const size_t max_polls = (2 * exec_us) / HD44780_BUSY_POLL_MIN_US;
+	size_t polls = 0;
+	bool busy;
+	do {
+		busy = hd44780_read_busy_flag();
+	} while (busy && (++polls < max_polls));
+
+	hd44780_config->io->set_pin_state(HD44780_PIN_RW, HD44780_LOW);
+	hd44780_config->io->set_data_dir(HD44780_DATA_OUTPUT);
+
+	if (measure) {
+		hd44780_update_busy_stats(hd44780_config->io->get_time_us() - start_us, busy);
+	}
+}
+
+static bool hd44780_send(uint8_t byte, hd44780_mode_t mode, uint16_t exec_us)
+{
+	/* I/O layer may want to do the whole transfer on its own */
+	if (hd44780_config->io->write_byte != NULL) {
+		if (!hd44780_config->io->write_byte((mode == HD44780_CHARACTER) ? HD44780_HIGH : HD44780_LOW, byte, exec_us)) {
+			hd44780_fb_invalidate();
+			return false;
+		}
+		return true;
+	}
+
+	/* Upper nibble goes first in 4-bit mode */
+	hd44780_write_nibble(byte >> 4, mode);
+	hd44780_write_nibble(byte & 0x0F, mode);
+
+	/* Wait for command to be executed */
+	hd44780_wait_ready(exec_us);
+
+	return true;
+}
+
+void hd44780_write_byte(uint8_t byte, hd44780_mode_t mode)
+{
+	hd44780_send(byte, mode, HD44780_EXEC_TIME_US);
+
+	/* Raw access, address counter can't be tracked anymore */
+	hd44780_fb.hw_addr = HD44780_ADDR_UNKNOWN;
 }
 
 void hd44780_write_cmd(uint8_t command)
@@ -103,18 +363,77 @@ void hd44780_write_cmd(uint8_t command)
 
 void hd44780_write_char(char character)
 {
-	hd44780_write_byte(character, HD44780_CHARACTER);
+	const hd44780_type_data_t *type_data = hd44780_get_type_data();
+
+	/* Characters outside of visible area are dropped, like in DDRAM */
+	if ((hd44780_fb.cursor_row < type_data->rows) && (hd44780_fb.cursor_col < type_data->columns)) {
+		const size_t index = hd44780_fb.cursor_row * type_data->columns + hd44780_fb.cursor_col;
+		hd44780_fb_set_cell(index, character);
+	}
+
+	/* Move cursor as the controller would, moving left from the first column leaves visible area */
+	if (hd44780_config->entry_mode_flags & HD44780_INCREASE_CURSOR_ON) {
+		++hd44780_fb.cursor_col;
+	}
+	else if (hd44780_fb.cursor_col > 0) {
+		--hd44780_fb.cursor_col;
+	}
+	else {
+		hd44780_fb.cursor_col = type_data->columns;
+	}
 }
 
 void hd44780_clear(void)
 {
-	/* Clear display */
-	hd44780_write_cmd(HD44780_CLEAR_DISPLAY_CMD);
-	hd44780_config->io->delay_us(1600); // At least 1.52ms (HD44780 datasheet, Table 6, p. 24)
+	const hd44780_type_data_t *type_data = hd44780_get_type_data();
+	const size_t cells = type_data->rows * type_data->columns;
+
+	for (size_t i = 0; i < cells; ++i) {
+		hd44780_fb_set_cell(i, ' ');
+	}
 
 	/* Set cursor to the first column of the first row */
-	const hd44780_type_data_t *type_data = &hd44780_type_data[hd44780_config->type];
-	hd44780_write_cmd(HD44780_SET_DDRAM_ADDR_CMD | type_data->rows_first_addr[0]);
+	hd44780_fb.cursor_row = 0;
+	hd44780_fb.cursor_col = 0;
+}
+
+void hd44780_flush(void)
+{
+	const hd44780_type_data_t *type_data = hd44780_get_type_data();
+	const bool increase = (hd44780_config->entry_mode_flags & HD44780_INCREASE_CURSOR_ON) != 0;
+
+	/* Load glyphs first, but only those still shown somewhere */
+	for (size_t i = 0; i < HD44780_CUSTOM_GLYPHS_NUM; ++i) {
+		hd44780_glyph_slot_t *slot = &hd44780_glyphs.slots[i];
+		if (slot->pending_load && (slot->refs > 0)) {
+			if (!hd44780_load_cgram(hd44780_glyphs.glyphs[slot->glyph_id], i)) {
+				return; // Everything is invalidated, retried on the next flush
+			}
+			slot->pending_load = false;
+		}
+	}
+
+	/* Consecutive dirty cells form a run, address is set only at its beginning */
+	for (size_t row = 0; row < type_data->rows; ++row) {
+		for (size_t col = 0; col < type_data->columns; ++col) {
+			const size_t index = row * type_data->columns + col;
+			if (!hd44780_fb_is_dirty(index)) {
+				continue;
+			}
+
+			const uint8_t address = type_data->rows_first_addr[row] + col;
+			if (!hd44780_set_hw_addr(address) || !hd44780_send(hd44780_fb.cells[index], HD44780_CHARACTER, HD44780_EXEC_TIME_US)) {
+				return;
+			}
+			hd44780_fb_set_dirty(index, false);
+			hd44780_fb.hw_addr = increase ? (address + 1) : HD44780_ADDR_UNKNOWN;
+		}
+	}
+
+	/* Move visible cursor where the user expects it */
+	if (hd44780_fb.cursor_shown && (hd44780_fb.cursor_row < type_data->rows) && (hd44780_fb.cursor_col < type_data->columns)) {
+		hd44780_set_hw_addr(type_data->rows_first_addr[hd44780_fb.cursor_row] + hd44780_fb.cursor_col);
+	}
 }
 
 void hd44780_show_cursor(bool show)
@@ -124,7 +443,8 @@ void hd44780_show_cursor(bool show)
 		command |= HD44780_CURSOR_ON;
 	}
 
-	hd44780_write_cmd(command);
+	hd44780_send(command, HD44780_INSTRUCTION, HD44780_EXEC_TIME_US);
+	hd44780_fb.cursor_shown = show;
 }
 
 void hd44780_gotoxy(size_t x, size_t y)
@@ -150,24 +470,23 @@ void hd44780_gotoxy(size_t x, size_t y)
 		y = type_data->columns;
 	}
 
-	/* Get address of selected row, add column offset */
-	const uint8_t required_address = type_data->rows_first_addr[x - 1] + y - 1;
-
-	/* Move to requested position */
-	hd44780_write_cmd(HD44780_SET_DDRAM_ADDR_CMD | required_address);
+	/* Move to requested position, hardware cursor follows on flush */
+	hd44780_fb.cursor_row = x - 1;
+	hd44780_fb.cursor_col = y - 1;
 }
 
 void hd44780_write_integer(int32_t number, size_t required_length)
 {
 	/* If number is negative, display minus sign and convert it to positive */
+	uint32_t magnitude = number;
 	if (number < 0) {
 		hd44780_write_char('-');
-		number = -number;
+		magnitude = -magnitude;
 	}
 
-	/* Convert number to string */
+	/* Convert number to string, without division */
 	char buffer[HD44780_TMP_BUF_SIZE];
-	itoa(number, buffer, 10);
+	utils_format_decimal(buffer, magnitude, UTILS_DEC_MAX_DIGITS, false, '\0');
 
 	/* Leading zeros handling - compute how many should be appended to get the required length and display them */
 	int leading_zeros = required_length - strlen(buffer);
@@ -186,6 +505,92 @@ void hd44780_write_string(const char *string)
 	}
 }
 
+void hd44780_write_padded(const char *string, size_t width)
+{
+	while ((width > 0) && (*string != '\0')) {
+		hd44780_write_char(*string++);
+		--width;
+	}
+
+	while (width > 0) {
+		hd44780_write_char(' ');
+		--width;
+	}
+}
+
+void hd44780_glyphs_register(const uint8_t (*glyphs)[HD44780_CGRAM_CHAR_SIZE], size_t count)
+{
+	hd44780_glyphs.glyphs = glyphs;
+	hd44780_glyphs.count = count;
+
+	/* Slots hold glyphs of the previous set, they can't be reused */
+	for (size_t i = 0; i < HD44780_CUSTOM_GLYPHS_NUM; ++i) {
+		hd44780_glyphs.slots[i].glyph_id = HD44780_GLYPH_NONE;
+		hd44780_glyphs.slots[i].pending_load = false;
+	}
+}
+
+static int hd44780_glyph_find_slot(size_t glyph_id)
+{
+	int victim = -1;
+	uint16_t victim_age = 0;
+
+	for (size_t i = 0; i < HD44780_CUSTOM_GLYPHS_NUM; ++i) {
+		const hd44780_glyph_slot_t *slot = &hd44780_glyphs.slots[i];
+
+		if (slot->glyph_id == glyph_id) {
+			return i;
+		}
+
+		/* Slots shown on screen can't be replaced, among the others prefer empty ones, then least recently used */
+		if (slot->refs > 0) {
+			continue;
+		}
+		const uint16_t age = (slot->glyph_id == HD44780_GLYPH_NONE) ? UINT16_MAX : (uint16_t)(hd44780_glyphs.clock - slot->last_used);
+		if ((victim < 0) || (age > victim_age)) {
+			victim = i;
+			victim_age = age;
+		}
+	}
+
+	if (victim >= 0) {
+		hd44780_glyphs.slots[victim].glyph_id = glyph_id;
+		hd44780_glyphs.slots[victim].pending_load = true;
+	}
+
+	return victim;
+}
+
+void hd44780_write_glyph(size_t glyph_id)
+{
+	if ((hd44780_glyphs.glyphs == NULL) || (glyph_id >= hd44780_glyphs.count)) {
+		hd44780_write_char(HD44780_GLYPH_FALLBACK_CHAR);
+		return;
+	}
+
+	const int slot = hd44780_glyph_find_slot(glyph_id);
+	if (slot < 0) {
+		hd44780_write_char(HD44780_GLYPH_FALLBACK_CHAR);
+		return;
+	}
+
+	hd44780_glyphs.slots[slot].last_used = ++hd44780_glyphs.clock;
+	hd44780_write_char(slot);
+}
+
+void hd44780_busy_measure_enable(bool enable)
+{
+	if (enable) {
+		memset(&hd44780_busy.stats, 0, sizeof(hd44780_busy.stats));
+	}
+	hd44780_busy.measure = enable;
+}
+
+void hd44780_get_busy_stats(hd44780_busy_stats_t *stats)
+{
+	*stats = hd44780_busy.stats;
+}
+
 void hd44780_load_custom_glyph(const uint8_t *glyph_array, hd44780_glyph_addr_t cgram_addr)
 {
 	/* If provided address out of range, select last one */
@@ -193,12 +598,5 @@ void hd44780_load_custom_glyph(const uint8_t *glyph_array, hd44780_glyph_addr_t
 		cgram_addr = HD44780_CUSTOM_GLYPH_7;
 	}
 
-	/* Set CGRAM pointer to required location */
-	const size_t cgram_offset = cgram_addr * HD44780_CGRAM_CHAR_SIZE;
-	hd44780_write_cmd(HD44780_SET_CGRAM_ADDR_CMD | cgram_offset);
-
-	/* Load character */
-	for (size_t i = 0; i < HD44780_CGRAM_CHAR_SIZE; i++) {
-		hd44780_write_char(glyph_array[i]);
-	}
+	hd44780_load_cgram(glyph_array, cgram_addr);
 }
@@ -85,6 +85,7 @@ typedef enum
 	HD44780_PIN_D5,
 	HD44780_PIN_D6,
 	HD44780_PIN_D7,
+	HD44780_PIN_RW, // Optional, needed only for busy flag polling
 	HD44780_PIN_NUM
 } hd44780_pin_t;
 
@@ -94,12 +95,39 @@ typedef enum
 	HD44780_HIGH
 } hd44780_pin_state_t;
 
+typedef enum
+{
+	HD44780_DATA_OUTPUT,
+	HD44780_DATA_INPUT
+} hd44780_data_dir_t;
+
 typedef struct
 {
 	void (*set_pin_state)(hd44780_pin_t pin, hd44780_pin_state_t state);
 	void (*delay_us)(uint16_t us);
+	/* Optional, sets RS and D4-D7 at once (nibble bit 0 goes to D4), preferred over set_pin_state() if provided */
+	void (*write_nibble)(hd44780_pin_state_t rs, uint8_t nibble);
+	/* Optional, takes over the whole byte transfer followed by exec_us wait, e.g. to do it asynchronously.
+	 * Preferred over all the above if provided. Returns false if the byte was dropped, the whole
+	 * framebuffer is sent again on the next flush then. */
+	bool (*write_byte)(hd44780_pin_state_t rs, uint8_t byte, uint16_t exec_us);
+	/* Optional, for boards with RW line connected - if both provided, busy flag is polled
+	 * instead of waiting fixed worst case time. Not used together with write_byte(). */
+	hd44780_pin_state_t (*get_pin_state)(hd44780_pin_t pin);
+	void (*set_data_dir)(hd44780_data_dir_t dir);
+	/* Optional, free running microsecond counter, needed only by busy time measurement */
+	uint32_t (*get_time_us)(void);
 } hd44780_io_t;
 
+typedef struct
+{
+	uint32_t count; // Number of measured waits
+	uint32_t timeouts; // Waits abandoned with busy flag still set
+	uint16_t min_us;
+	uint16_t max_us;
+	uint16_t last_us;
+} hd44780_busy_stats_t;
+
 typedef struct
 {
 	hd44780_io_t *io;
@@ -115,7 +143,7 @@ typedef struct
 void hd44780_init(const hd44780_config_t *config);
 
 /**
- * @brief Writes one byte of data to display
+ * @brief Writes one byte of data to display, bypassing the framebuffer
  *
  * @param byte Value to be written to display
  *
@@ -131,17 +159,23 @@ void hd44780_write_byte(uint8_t byte, hd44780_mode_t mode);
 void hd44780_write_cmd(uint8_t command);
 
 /**
- * @brief Writes character to HD44780 display, wrapper for hd44780_write_byte()
+ * @brief Writes character to framebuffer at cursor position, shown after hd44780_flush()
  *
  * @param character Character to be written
  */
 void hd44780_write_char(char character);
 
 /**
- * @brief Clears the display and positions the cursor in first column of the first row
+ * @brief Clears the framebuffer and positions the cursor in first column of the first row
  */
 void hd44780_clear(void);
 
+/**
+ * @brief Sends framebuffer cells changed since the last flush to the display
+ * 		  and moves the visible cursor to its position
+ */
+void hd44780_flush(void);
+
 /**
  * @brief Enables cursor visibility without blinking
  *
@@ -174,6 +208,48 @@ void hd44780_write_integer(int32_t number, size_t length);
  */
 void hd44780_write_string(const char *string);
 
+/**
+ * @brief Registers set of glyphs to be shown with hd44780_write_glyph(), the array
+ * 		  has to stay valid as long as the glyphs are in use
+ *
+ * @param glyphs Array of glyphs in required format, index in the array is glyph ID
+ * @param count Number of glyphs, can exceed number of CGRAM slots
+ */
+void hd44780_glyphs_register(const uint8_t (*glyphs)[HD44780_CGRAM_CHAR_SIZE], size_t count);
+
+/**
+ * @brief Writes registered glyph to framebuffer at cursor position. Glyphs are assigned
+ * 		  to CGRAM slots on demand, replacing the least recently used one not shown on screen,
+ * 		  and loaded on flush. If all slots are shown, space is written instead.
+ *
+ * @param glyph_id Index of the glyph in the registered array
+ */
+void hd44780_write_glyph(size_t glyph_id);
+
+/**
+ * @brief Enables measurement of how long the controller actually stays busy,
+ * 		  works only in busy flag polling mode
+ *
+ * @param enable True to start collecting statistics (clears previous ones), false to stop
+ */
+void hd44780_busy_measure_enable(bool enable);
+
+/**
+ * @brief Gets busy time statistics collected in measurement mode
+ *
+ * @param stats Pointer to struct to be filled
+ */
+void hd44780_get_busy_stats(hd44780_busy_stats_t *stats);
+
+/**
+ * @brief Displays null-terminated string and fills the rest of the field with spaces,
+ * 		  so that leftovers of longer previous contents get blanked without clearing the display
+ *
+ * @param string Null-terminated string to be displayed, truncated if longer than the field
+ * @param width Width of the field
+ */
+void hd44780_write_padded(const char *string, size_t width);
+
 /**
  * @brief Loads custom glyph to HD44780's CGRAM
  *
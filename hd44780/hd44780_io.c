@@ -8,9 +8,25 @@
 #include "hd44780_io.h"
 #include <gpio.h>
 #include <delay.h>
+#include <errno.h>
 
 #define HD44780_GPIO_PORT GPIO_LCD_PORT
-#define HD44780_US_PER_MS 1000
+#define HD44780_BSHR_RESET_SHIFT 16 // Upper half of BSHR resets pins
+
+/* BSHR value driving D4-D7 to given nibble, sets pins for ones and resets them for zeros */
+#define HD44780_PIN_BSHR(nibble, bit, pin) (((nibble) & (1 << (bit))) ? (pin) : ((uint32_t)(pin) << HD44780_BSHR_RESET_SHIFT))
+#define HD44780_NIBBLE_BSHR(nibble) (HD44780_PIN_BSHR(nibble, 0, GPIO_LCD_D4_PIN) | HD44780_PIN_BSHR(nibble, 1, GPIO_LCD_D5_PIN) | \
+									 HD44780_PIN_BSHR(nibble, 2, GPIO_LCD_D6_PIN) | HD44780_PIN_BSHR(nibble, 3, GPIO_LCD_D7_PIN))
+
+#ifdef HD44780_IO_ASYNC
+#define HD44780_IO_TIMER TIM2
+#define HD44780_IO_TIMER_IRQ TIM2_IRQn
+#define HD44780_IO_TIMER_TICK_FREQ_HZ 1000000 // Timer counts microseconds
+#define HD44780_IO_E_PULSE_US 1 // At least 450ns (HD44780 datasheet, p. 49)
+#define HD44780_IO_QUEUE_SIZE 32 // Must be a power of two
+#define HD44780_IO_QUEUE_MASK (HD44780_IO_QUEUE_SIZE - 1)
+#define HD44780_IO_TIMEOUT_MS 100
+#endif
 
 typedef struct
 {
@@ -18,19 +34,59 @@ typedef struct
 	hd44780_pin_t display_pin;
 } hd44780_gpio_map_t;
 
-static const hd44780_gpio_map_t gpio_map[HD44780_PIN_NUM] =
+#ifdef HD44780_IO_ASYNC
+typedef enum
+{
+	HD44780_IO_PHASE_IDLE,
+	HD44780_IO_PHASE_UPPER_NIBBLE, // E high, upper nibble on the bus
+	HD44780_IO_PHASE_LOWER_NIBBLE, // E high, lower nibble on the bus
+	HD44780_IO_PHASE_EXEC // Waiting for the controller to execute
+} hd44780_io_phase_t;
+
+typedef struct
+{
+	uint8_t byte;
+	uint8_t rs;
+	uint16_t exec_us;
+} hd44780_io_entry_t;
+
+typedef struct
+{
+	hd44780_io_entry_t entries[HD44780_IO_QUEUE_SIZE];
+	volatile uint8_t head; // Written by producer
+	volatile uint8_t tail; // Written by timer interrupt
+	volatile hd44780_io_phase_t phase;
+} hd44780_io_ctx_t;
+
+static hd44780_io_ctx_t ctx;
+#endif
+
+static const hd44780_gpio_map_t gpio_map[] =
 {
 		{.gpio_pin = GPIO_LCD_D4_PIN, .display_pin = HD44780_PIN_D4},
 		{.gpio_pin = GPIO_LCD_D5_PIN, .display_pin = HD44780_PIN_D5},
 		{.gpio_pin = GPIO_LCD_D6_PIN, .display_pin = HD44780_PIN_D6},
 		{.gpio_pin = GPIO_LCD_D7_PIN, .display_pin = HD44780_PIN_D7},
 		{.gpio_pin = GPIO_LCD_RS_PIN, .display_pin = HD44780_PIN_RS},
-		{.gpio_pin = GPIO_LCD_E_PIN, .display_pin = HD44780_PIN_E}
+		{.gpio_pin = GPIO_LCD_E_PIN, .display_pin = HD44780_PIN_E},
+#ifdef GPIO_LCD_RW_PIN
+		{.gpio_pin = GPIO_LCD_RW_PIN, .display_pin = HD44780_PIN_RW}
+#endif
+};
+
+#define HD44780_GPIO_MAP_SIZE (sizeof(gpio_map) / sizeof(gpio_map[0]))
+
+static const uint32_t nibble_bshr[16] =
+{
+		HD44780_NIBBLE_BSHR(0x0), HD44780_NIBBLE_BSHR(0x1), HD44780_NIBBLE_BSHR(0x2), HD44780_NIBBLE_BSHR(0x3),
+		HD44780_NIBBLE_BSHR(0x4), HD44780_NIBBLE_BSHR(0x5), HD44780_NIBBLE_BSHR(0x6), HD44780_NIBBLE_BSHR(0x7),
+		HD44780_NIBBLE_BSHR(0x8), HD44780_NIBBLE_BSHR(0x9), HD44780_NIBBLE_BSHR(0xA), HD44780_NIBBLE_BSHR(0xB),
+		HD44780_NIBBLE_BSHR(0xC), HD44780_NIBBLE_BSHR(0xD), HD44780_NIBBLE_BSHR(0xE), HD44780_NIBBLE_BSHR(0xF)
 };
 
 static void hd44780_io_set_pin_state(hd44780_pin_t pin, hd44780_pin_state_t state)
 {
-	for (size_t i = 0; i < HD44780_PIN_NUM; ++i) {
+	for (size_t i = 0; i < HD44780_GPIO_MAP_SIZE; ++i) {
 		if (gpio_map[i].display_pin == pin) {
 			GPIO_WriteBit(HD44780_GPIO_PORT, gpio_map[i].gpio_pin, (BitAction)state);
 			break;
@@ -38,21 +94,180 @@ static void hd44780_io_set_pin_state(hd44780_pin_t pin, hd44780_pin_state_t stat
 	}
 }
 
+#ifdef GPIO_LCD_RW_PIN
+static hd44780_pin_state_t hd44780_io_get_pin_state(hd44780_pin_t pin)
+{
+	for (size_t i = 0; i < HD44780_GPIO_MAP_SIZE; ++i) {
+		if (gpio_map[i].display_pin == pin) {
+			return (hd44780_pin_state_t)GPIO_ReadInputDataBit(HD44780_GPIO_PORT, gpio_map[i].gpio_pin);
+		}
+	}
+
+	return HD44780_LOW;
+}
+
+static void hd44780_io_set_data_dir(hd44780_data_dir_t dir)
+{
+	GPIO_InitTypeDef gpio_cfg = {0};
+
+	gpio_cfg.GPIO_Pin = GPIO_LCD_D4_PIN | GPIO_LCD_D5_PIN | GPIO_LCD_D6_PIN | GPIO_LCD_D7_PIN;
+	gpio_cfg.GPIO_Mode = (dir == HD44780_DATA_INPUT) ? GPIO_Mode_IN_FLOATING : GPIO_Mode_Out_PP;
+	gpio_cfg.GPIO_Speed = GPIO_Speed_10MHz;
+	GPIO_Init(HD44780_GPIO_PORT, &gpio_cfg);
+}
+#endif
+
+static void hd44780_io_write_nibble(hd44780_pin_state_t rs, uint8_t nibble)
+{
+	const uint32_t rs_bshr = (rs == HD44780_HIGH) ? GPIO_LCD_RS_PIN : ((uint32_t)GPIO_LCD_RS_PIN << HD44780_BSHR_RESET_SHIFT);
+
+	/* All data lines and RS are on the same port, single store updates them at once */
+	HD44780_GPIO_PORT->BSHR = nibble_bshr[nibble & 0x0F] | rs_bshr;
+}
+
 static void hd44780_io_delay_us(uint16_t us)
 {
-	uint16_t ms = us / HD44780_US_PER_MS;
-	if (ms == 0) {
-		++ms;
+	delay_us(us);
+}
+
+#ifdef HD44780_IO_ASYNC
+static void hd44780_io_schedule(uint16_t us)
+{
+	/* One-pulse mode, counter stops by itself on update */
+	HD44780_IO_TIMER->ATRLR = us;
+	HD44780_IO_TIMER->CNT = 0;
+	TIM_Cmd(HD44780_IO_TIMER, ENABLE);
+}
+
+/* Called with timer interrupt masked or from the interrupt itself */
+static void hd44780_io_start_next(void)
+{
+	if (ctx.tail == ctx.head) {
+		ctx.phase = HD44780_IO_PHASE_IDLE;
+		return;
+	}
+
+	const hd44780_io_entry_t *entry = &ctx.entries[ctx.tail];
+	hd44780_io_write_nibble(entry->rs, entry->byte >> 4);
+	HD44780_GPIO_PORT->BSHR = GPIO_LCD_E_PIN;
+	ctx.phase = HD44780_IO_PHASE_UPPER_NIBBLE;
+	hd44780_io_schedule(HD44780_IO_E_PULSE_US);
+}
+
+static bool hd44780_io_write_byte(hd44780_pin_state_t rs, uint8_t byte, uint16_t exec_us)
+{
+	/* Wait for free slot, one is always left empty to tell full queue from empty one */
+	const uint32_t start_tick = delay_get_ticks();
+	while (((ctx.head + 1) & HD44780_IO_QUEUE_MASK) == ctx.tail) {
+		if ((delay_get_ticks() - start_tick) >= HD44780_IO_TIMEOUT_MS) {
+			return false;
+		}
+	}
+
+	NVIC_DisableIRQ(HD44780_IO_TIMER_IRQ);
+
+	ctx.entries[ctx.head].byte = byte;
+	ctx.entries[ctx.head].rs = rs;
+	ctx.entries[ctx.head].exec_us = exec_us;
+	ctx.head = (ctx.head + 1) & HD44780_IO_QUEUE_MASK;
+
+	if (ctx.phase == HD44780_IO_PHASE_IDLE) {
+		hd44780_io_start_next();
 	}
-	delay_ms(ms);
+
+	NVIC_EnableIRQ(HD44780_IO_TIMER_IRQ);
+
+	return true;
 }
+#endif
 
 hd44780_io_t *hd44780_io_get(void)
 {
 	static hd44780_io_t io = {
 			.set_pin_state = hd44780_io_set_pin_state,
-			.delay_us = hd44780_io_delay_us
+			.delay_us = hd44780_io_delay_us,
+			.write_nibble = hd44780_io_write_nibble,
+#ifdef GPIO_LCD_RW_PIN
+			.get_pin_state = hd44780_io_get_pin_state,
+			.set_data_dir = hd44780_io_set_data_dir,
+#endif
+			.get_time_us = delay_get_us,
+#ifdef HD44780_IO_ASYNC
+			.write_byte = hd44780_io_write_byte
+#endif
 	};
 
 	return &io;
 }
+
+void hd44780_io_init(void)
+{
+#ifdef HD44780_IO_ASYNC
+	TIM_TimeBaseInitTypeDef tim_cfg = {0};
+	NVIC_InitTypeDef nvic_cfg = {0};
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+
+	tim_cfg.TIM_Prescaler = (SystemCoreClock / HD44780_IO_TIMER_TICK_FREQ_HZ) - 1;
+	tim_cfg.TIM_CounterMode = TIM_CounterMode_Up;
+	tim_cfg.TIM_Period = HD44780_IO_E_PULSE_US;
+	tim_cfg.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseInit(HD44780_IO_TIMER, &tim_cfg);
+	TIM_SelectOnePulseMode(HD44780_IO_TIMER, TIM_OPMode_Single);
+
+	/* Update event is generated by TIM_TimeBaseInit() to load prescaler, don't let it fire */
+	TIM_ClearITPendingBit(HD44780_IO_TIMER, TIM_IT_Update);
+	TIM_ITConfig(HD44780_IO_TIMER, TIM_IT_Update, ENABLE);
+
+	/* Lowest priority, display timing is relaxed - only minimums are specified */
+	nvic_cfg.NVIC_IRQChannel = HD44780_IO_TIMER_IRQ;
+	nvic_cfg.NVIC_IRQChannelPreemptionPriority = 2;
+	nvic_cfg.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&nvic_cfg);
+
+	ctx.phase = HD44780_IO_PHASE_IDLE;
+#endif
+}
+
+bool hd44780_io_is_idle(void)
+{
+#ifdef HD44780_IO_ASYNC
+	return ctx.phase == HD44780_IO_PHASE_IDLE;
+#else
+	return true;
+#endif
+}
+
+#ifdef HD44780_IO_ASYNC
+void TIM2_IRQHandler(void)
+{
+	if (TIM_GetITStatus(HD44780_IO_TIMER, TIM_IT_Update) == RESET) {
+		return;
+	}
+	TIM_ClearITPendingBit(HD44780_IO_TIMER, TIM_IT_Update);
+
+	const hd44780_io_entry_t *entry = &ctx.entries[ctx.tail];
+
+	switch (ctx.phase) {
+		case HD44780_IO_PHASE_UPPER_NIBBLE:
+			/* Data is latched on falling edge of E, change it only afterwards */
+			HD44780_GPIO_PORT->BCR = GPIO_LCD_E_PIN;
+			hd44780_io_write_nibble(entry->rs, entry->byte & 0x0F);
+			HD44780_GPIO_PORT->BSHR = GPIO_LCD_E_PIN;
+			ctx.phase = HD44780_IO_PHASE_LOWER_NIBBLE;
+			hd44780_io_schedule(HD44780_IO_E_PULSE_US);
+			break;
+		case HD44780_IO_PHASE_LOWER_NIBBLE:
+			HD44780_GPIO_PORT->BCR = GPIO_LCD_E_PIN;
+			ctx.phase = HD44780_IO_PHASE_EXEC;
+			hd44780_io_schedule(entry->exec_us);
+			break;
+		case HD44780_IO_PHASE_EXEC:
+			ctx.tail = (ctx.tail + 1) & HD44780_IO_QUEUE_MASK;
+			hd44780_io_start_next();
+			break;
+		default:
+			break;
+	}
+}
+#endif
@@ -12,4 +12,12 @@
 
 hd44780_io_t *hd44780_io_get(void);
 
+/* With HD44780_IO_ASYNC defined, display writes are queued and clocked out from TIM2 interrupt */
+void hd44780_io_init(void);
+bool hd44780_io_is_idle(void);
+
+#ifdef HD44780_IO_ASYNC
+void TIM2_IRQHandler(void) __attribute__((interrupt));
+#endif
+
 #endif /* HD44780_IO_H_ */
@@ -20,17 +20,25 @@ static void show_welcome_screen(void)
 	hd44780_write_string("AD9833 generator");
 	hd44780_gotoxy(2, 1);
 	hd44780_write_string("Lefucjusz, 2025");
+	hd44780_flush();
 	delay_ms(750);
 
 	hd44780_clear();
 	hd44780_write_string("Software " VERSION);
+	hd44780_flush();
 	delay_ms(750);
 
 	hd44780_clear();
+	hd44780_flush();
 }
 
-static void enter_sleep_mode(void)
+static void enter_sleep_mode(bool keep_tick)
 {
+	if (keep_tick) {
+		__WFI();
+		return;
+	}
+
 	delay_suspend_tick();
 	__WFI();
 	delay_resume_tick();
@@ -50,6 +58,7 @@ int main(void)
 	delay_init();
 	gpio_init();
 	spi_init();
+	hd44780_io_init();
 	hd44780_init(&display_config);
 	encoder_init();
 
@@ -71,8 +80,12 @@ int main(void)
 	while (1) {
 		gui_task();
 
+		/* Pending interrupt still ends WFI, masking only keeps an event queued after the check
+		 * from being left unhandled until the next one */
+		__disable_irq();
 		if (gui_is_idle()) {
-			enter_sleep_mode();
+			enter_sleep_mode(gui_needs_tick());
 		}
+		__enable_irq();
 	}
 }
@@ -1,62 +1,106 @@
 #include "settings.h"
 #include <eeprom.h>
+#include <flash_log.h>
 #include <dds.h>
+#include <delay.h>
 #include <errno.h>
 #include <stddef.h>
 #include <assert.h>
 
-/* Each EEPROM variable is 16-bit, we store everything as 32-bit */
+/* Settings are kept as one record holding all entries in the flash log. Its slot is the commit
+ * record - a commit torn by power loss fails slot CRC and the previous one is read back, so entries
+ * written between two commits become visible together or not at all. */
+#define SETTINGS_LOG_KEY 0
+
+#define SETTINGS_RECORD_VERSION 1
+
+/* Legacy format - each 32-bit entry split into two 16-bit EEPROM emulation variables */
 #define SETTINGS_CELLS_PER_ENTRY 2
 #define SETTINGS_ENTRIES_NUM (NB_OF_VAR / SETTINGS_CELLS_PER_ENTRY)
 
-/* Defaults used to initialize the EEPROM */
+/* Changes are written back once no entry changed for that long */
+#ifndef SETTINGS_WRITEBACK_DELAY_MS
+#define SETTINGS_WRITEBACK_DELAY_MS 2000
+#endif
+
+/* Defaults used to initialize the settings */
 #define SETTINGS_DEFAULT_FREQ 1000 // Hz
 #define SETTINGS_DEFAULT_AMPL 10 // V * 10
 #define SETTINGS_DEFAULT_WAVEFORM DDS_MODE_SINE
 
+typedef struct
+{
+	uint8_t version;
+	uint8_t entries_num;
+	uint32_t values[SETTINGS_COUNT];
+} settings_record_t;
+
+typedef struct
+{
+	settings_record_t record; // Working copy, entries are read and written here
+	uint32_t dirty_mask; // Entries changed since the last commit
+	uint32_t dirty_tick; // Time of the last change
+} settings_ctx_t;
+
+static settings_ctx_t ctx;
+
 uint16_t VirtAddVarTab[NB_OF_VAR];
 
-static_assert(SETTINGS_COUNT <= SETTINGS_ENTRIES_NUM, "Not enough EEPROM variables for the required settings number. Adjust NB_OF_VAR in eeprom.h");
+static_assert(sizeof(settings_record_t) <= FLASH_LOG_DATA_MAX_SIZE, "Settings record does not fit in a flash log slot");
+static_assert(SETTINGS_LOG_KEY < FLASH_LOG_KEYS_NUM, "Settings key out of flash log range");
+static_assert(SETTINGS_COUNT <= 32, "Dirty mask has one bit per entry");
+static_assert(SETTINGS_COUNT <= SETTINGS_ENTRIES_NUM, "Not enough EEPROM variables for legacy settings migration. Adjust NB_OF_VAR in eeprom.h");
 
-static int settings_load_default(void)
+static bool settings_record_is_valid(const settings_record_t *record)
 {
-	int err = settings_write(SETTINGS_DEFAULT_FREQ, SETTINGS_FREQUENCY);
-	if (err) {
-		return err;
+	return (record->version == SETTINGS_RECORD_VERSION) && (record->entries_num == SETTINGS_COUNT);
+}
+
+static int settings_read_legacy(uint32_t *value, settings_entry_t entry)
+{
+	uint16_t temp;
+	const uint16_t base_addr = SETTINGS_CELLS_PER_ENTRY * entry;
+
+	uint16_t err = EE_ReadVariable(base_addr, &temp);
+	if (err == NO_VALID_PAGE) {
+		return -EIO;
 	}
-	err = settings_write(SETTINGS_DEFAULT_AMPL, SETTINGS_AMPLITUDE);
-	if (err) {
-		return err;
+	else if (err) {
+		return -ENOENT;
 	}
-	err = settings_write(SETTINGS_DEFAULT_WAVEFORM, SETTINGS_WAVEFORM);
-	if (err) {
-		return err;
+	*value = (uint32_t)temp << 16;
+
+	err = EE_ReadVariable(base_addr + 1, &temp);
+	if (err == NO_VALID_PAGE) {
+		return -EIO;
+	}
+	else if (err) {
+		return -ENOENT;
 	}
+	*value |= temp;
 
 	return 0;
 }
 
-int settings_init(void)
+/* Picks up settings stored by older firmware in EEPROM emulation, fails if there are none */
+static int settings_load_legacy(void)
 {
+	/* Never used, don't let EE_Init() format the pages */
+	if (((*(volatile uint16_t *)PAGE0_BASE_ADDRESS) == ERASED) && ((*(volatile uint16_t *)PAGE1_BASE_ADDRESS) == ERASED)) {
+		return -ENOENT;
+	}
+
 	/* Fill virtual address table */
 	for (size_t i = 0; i < NB_OF_VAR; ++i) {
 		VirtAddVarTab[i] = i;
 	}
 
-	FLASH_Unlock_Fast();
-
 	if (EE_Init() != FLASH_COMPLETE) {
 		return -EIO;
 	}
 
-	/* Check if EEPROM already populated, if not, populate with defaults */
-	uint32_t dummy;
-	int err = settings_read(&dummy, SETTINGS_FREQUENCY);
-	if (err == -EIO) {
-		return -EIO;
-	}
-	else if (err == -ENOENT) {
-		err = settings_load_default();
+	for (size_t i = 0; i < SETTINGS_COUNT; ++i) {
+		const int err = settings_read_legacy(&ctx.record.values[i], i);
 		if (err) {
 			return err;
 		}
@@ -65,50 +109,92 @@ int settings_init(void)
 	return 0;
 }
 
-int settings_write(uint32_t value, settings_entry_t entry)
+static void settings_load_default(void)
 {
-	if (entry >= SETTINGS_ENTRIES_NUM) {
-		return -EINVAL;
+	ctx.record.values[SETTINGS_FREQUENCY] = SETTINGS_DEFAULT_FREQ;
+	ctx.record.values[SETTINGS_AMPLITUDE] = SETTINGS_DEFAULT_AMPL;
+	ctx.record.values[SETTINGS_WAVEFORM] = SETTINGS_DEFAULT_WAVEFORM;
+}
+
+int settings_init(void)
+{
+	FLASH_Unlock_Fast();
+
+	int err = flash_log_init();
+	if (err) {
+		return err;
 	}
 
-	const uint16_t base_addr = SETTINGS_CELLS_PER_ENTRY * entry;
+	/* Record torn by power loss fails its CRC in the log, so the previous complete one is read */
+	err = flash_log_read(SETTINGS_LOG_KEY, &ctx.record, sizeof(ctx.record));
+	if ((err == 0) && settings_record_is_valid(&ctx.record)) {
+		return 0;
+	}
+	else if ((err != 0) && (err != -ENOENT)) {
+		return err;
+	}
 
-	if (EE_WriteVariable(base_addr, (value >> 16) & 0xFFFF) != FLASH_COMPLETE) {
-		return -EIO;
+	/* Log is empty, populate it with legacy settings or defaults */
+	ctx.record.version = SETTINGS_RECORD_VERSION;
+	ctx.record.entries_num = SETTINGS_COUNT;
+	if (settings_load_legacy() != 0) {
+		settings_load_default();
 	}
-	if (EE_WriteVariable(base_addr + 1, value & 0xFFFF) != FLASH_COMPLETE) {
-		return -EIO;
+
+	return settings_commit();
+}
+
+int settings_write(uint32_t value, settings_entry_t entry)
+{
+	if (entry >= SETTINGS_COUNT) {
+		return -EINVAL;
+	}
+
+	/* Identical value costs neither a commit nor flash wear */
+	if (ctx.record.values[entry] == value) {
+		return 0;
 	}
 
+	ctx.record.values[entry] = value;
+	ctx.dirty_mask |= (1UL << entry);
+	ctx.dirty_tick = delay_get_ticks();
+
 	return 0;
 }
 
 int settings_read(uint32_t *value, settings_entry_t entry)
 {
-	if ((entry >= SETTINGS_ENTRIES_NUM) || (value == NULL)) {
+	if ((entry >= SETTINGS_COUNT) || (value == NULL)) {
 		return -EINVAL;
 	}
 
-	uint16_t temp;
-	const uint16_t base_addr = SETTINGS_CELLS_PER_ENTRY * entry;
+	*value = ctx.record.values[entry];
 
-	uint16_t err = EE_ReadVariable(base_addr, &temp);
-	if (err == NO_VALID_PAGE) {
-		return -EIO;
-	}
-	else if (err) {
-		return -ENOENT;
-	}
-	*value = (uint32_t)temp << 16;
+	return 0;
+}
 
-	err = EE_ReadVariable(base_addr + 1, &temp);
-	if (err == NO_VALID_PAGE) {
-		return -EIO;
-	}
-	else if (err) {
-		return -ENOENT;
+int settings_commit(void)
+{
+	const int err = flash_log_write(SETTINGS_LOG_KEY, &ctx.record, sizeof(ctx.record));
+	if (err) {
+		return err;
 	}
-	*value |= temp;
+
+	ctx.dirty_mask = 0;
 
 	return 0;
 }
+
+bool settings_is_dirty(void)
+{
+	return (ctx.dirty_mask != 0);
+}
+
+int settings_task(void)
+{
+	if (!settings_is_dirty() || ((delay_get_ticks() - ctx.dirty_tick) < SETTINGS_WRITEBACK_DELAY_MS)) {
+		return 0;
+	}
+
+	return settings_commit();
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef enum
 {
@@ -12,5 +13,12 @@ typedef enum
 
 int settings_init(void);
 
+/* Entries are read from and written to RAM copy, settings_commit() stores all of them in flash as one record */
 int settings_write(uint32_t value, settings_entry_t entry);
 int settings_read(uint32_t *value, settings_entry_t entry);
+int settings_commit(void);
+
+/* Write-back - settings_task() commits changed entries once SETTINGS_WRITEBACK_DELAY_MS passed
+ * without further changes. SysTick has to keep running while settings_is_dirty() is true. */
+bool settings_is_dirty(void);
+int settings_task(void);
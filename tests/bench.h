@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/* Keeps results alive, so that the compiler can't drop benchmarked calls */
+static volatile uint32_t bench_sink;
+
+static inline uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
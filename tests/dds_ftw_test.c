@@ -0,0 +1,124 @@
+#include <dds_ftw.h>
+#include <utils.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include "bench.h"
+
+#define TEST_MHZ_STRIDE 997 // Prime, hits every residue of the rounding step across the range
+#define TEST_MHZ_EDGE_SPAN 1000000 // Checked one by one at both ends of milli-Hz range
+
+typedef struct
+{
+	uint64_t checked;
+	uint64_t mismatches;
+	double max_error_lsb; // Against double-precision model
+} test_result_t;
+
+/* Exact round half up of frequency * 2^28 / xtal_frequency */
+static uint32_t reference_ftw(uint64_t frequency, uint64_t xtal_frequency)
+{
+	const unsigned __int128 scaled = (unsigned __int128)frequency << (DDS_FREQ_REG_BITS + 1);
+
+	return (uint32_t)((scaled + xtal_frequency) / (2 * (unsigned __int128)xtal_frequency));
+}
+
+static double model_ftw(uint64_t frequency, uint64_t xtal_frequency)
+{
+	return ((double)frequency * DDS_FREQ_REG_MAX_VALUE) / (double)xtal_frequency;
+}
+
+static void check(test_result_t *result, uint64_t frequency, uint64_t xtal_frequency)
+{
+	const uint32_t ftw = dds_compute_ftw(frequency, xtal_frequency);
+	const double error = fabs((double)ftw - model_ftw(frequency, xtal_frequency));
+
+	if (ftw != reference_ftw(frequency, xtal_frequency)) {
+		if (result->mismatches == 0) {
+			printf("  first mismatch at %llu: got %u, expected %u\n", (unsigned long long)frequency, ftw, reference_ftw(frequency, xtal_frequency));
+		}
+		++result->mismatches;
+	}
+	result->max_error_lsb = fmax(result->max_error_lsb, error);
+	++result->checked;
+}
+
+static bool report(const char *name, const test_result_t *result)
+{
+	/* Correct rounding is never more than half LSB off, allow for double model's own error */
+	const bool passed = (result->mismatches == 0) && (result->max_error_lsb <= 0.5 + 1e-6);
+
+	printf("%s: %llu inputs, %llu mismatches, max error %.6f LSB - %s\n", name, (unsigned long long)result->checked,
+		   (unsigned long long)result->mismatches, result->max_error_lsb, passed ? "PASS" : "FAIL");
+
+	return passed;
+}
+
+static bool test_hz(void)
+{
+	test_result_t result = {0};
+
+	for (uint64_t frequency = 0; frequency <= DDS_MAX_OUTPUT_FREQ_HZ; ++frequency) {
+		check(&result, frequency, DDS_XTAL_FREQ_HZ);
+	}
+
+	return report("Hz, exhaustive", &result);
+}
+
+static bool test_mhz(void)
+{
+	const uint64_t xtal_frequency = DDS_XTAL_FREQ_HZ * DDS_MILLIHZ_PER_HZ;
+	test_result_t result = {0};
+
+	/* 12.5 billion inputs take too long one by one, cover the range with a stride and the ends fully */
+	for (uint64_t frequency = 0; frequency <= DDS_MAX_OUTPUT_FREQ_MHZ; frequency += TEST_MHZ_STRIDE) {
+		check(&result, frequency, xtal_frequency);
+	}
+	for (uint64_t frequency = 0; frequency < TEST_MHZ_EDGE_SPAN; ++frequency) {
+		check(&result, frequency, xtal_frequency);
+		check(&result, DDS_MAX_OUTPUT_FREQ_MHZ - frequency, xtal_frequency);
+	}
+
+	return report("mHz, strided and range ends", &result);
+}
+
+/* Float path as it was before the integer one, for comparison only */
+static uint32_t float_ftw(float frequency)
+{
+	return (uint32_t)utils_roundf(frequency * ((float)DDS_FREQ_REG_MAX_VALUE / DDS_XTAL_FREQ_HZ));
+}
+
+static void benchmark(void)
+{
+	double float_max_error = 0.0;
+	uint64_t start;
+
+	start = bench_now_ns();
+	for (uint32_t frequency = 0; frequency <= DDS_MAX_OUTPUT_FREQ_HZ; ++frequency) {
+		bench_sink = dds_compute_ftw(frequency, DDS_XTAL_FREQ_HZ);
+	}
+	const double integer_ns = (double)(bench_now_ns() - start) / (DDS_MAX_OUTPUT_FREQ_HZ + 1);
+
+	start = bench_now_ns();
+	for (uint32_t frequency = 0; frequency <= DDS_MAX_OUTPUT_FREQ_HZ; ++frequency) {
+		bench_sink = float_ftw((float)frequency);
+	}
+	const double float_ns = (double)(bench_now_ns() - start) / (DDS_MAX_OUTPUT_FREQ_HZ + 1);
+
+	for (uint32_t frequency = 0; frequency <= DDS_MAX_OUTPUT_FREQ_HZ; ++frequency) {
+		float_max_error = fmax(float_max_error, fabs((double)float_ftw((float)frequency) - model_ftw(frequency, DDS_XTAL_FREQ_HZ)));
+	}
+
+	/* Host has FPU and divider, absolute numbers say nothing about RV32EC, errors do */
+	printf("Integer path: %.2f ns per call on host\n", integer_ns);
+	printf("Float path: %.2f ns per call on host, max error %.2f LSB\n", float_ns, float_max_error);
+}
+
+int main(void)
+{
+	bool passed = test_hz();
+	passed = test_mhz() && passed;
+	benchmark();
+
+	return passed ? 0 : 1;
+}
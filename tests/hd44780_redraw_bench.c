@@ -0,0 +1,87 @@
+#include <hd44780.h>
+#include <stdio.h>
+
+#define BENCH_US_PER_MS 1000
+#define BENCH_DISPLAY_CELLS 32 // 16x2
+#define BENCH_REDRAWS_NUM 100
+
+/* Simulated time spent in delays, the CPU only busy-waits there. The old I/O layer rounded
+ * every delay to whole milliseconds and delay_ms() waited one more partial tick on top. */
+typedef struct
+{
+	uint64_t us;
+	uint64_t legacy_min_us;
+	uint64_t legacy_max_us;
+} bench_time_t;
+
+static bench_time_t sim_time;
+
+static void sim_set_pin_state(hd44780_pin_t pin, hd44780_pin_state_t state)
+{
+	(void)pin;
+	(void)state;
+}
+
+static void sim_write_nibble(hd44780_pin_state_t rs, uint8_t nibble)
+{
+	(void)rs;
+	(void)nibble;
+}
+
+static void sim_delay_us(uint16_t us)
+{
+	uint16_t ms = us / BENCH_US_PER_MS;
+	if (ms == 0) {
+		++ms;
+	}
+
+	sim_time.us += us;
+	sim_time.legacy_min_us += ms * BENCH_US_PER_MS;
+	sim_time.legacy_max_us += (ms + 1) * BENCH_US_PER_MS;
+}
+
+static hd44780_io_t sim_io = {
+	.set_pin_state = sim_set_pin_state,
+	.delay_us = sim_delay_us,
+	.write_nibble = sim_write_nibble
+};
+
+/* Rewrites every cell, so the framebuffer has to send the whole screen */
+static void redraw(char fill)
+{
+	hd44780_gotoxy(1, 1);
+	for (size_t i = 0; i < BENCH_DISPLAY_CELLS; ++i) {
+		if (i == (BENCH_DISPLAY_CELLS / 2)) {
+			hd44780_gotoxy(2, 1);
+		}
+		hd44780_write_char(fill);
+	}
+	hd44780_flush();
+}
+
+int main(void)
+{
+	const hd44780_config_t config = {
+		.io = &sim_io,
+		.type = HD44780_DISPLAY_16x2,
+		.entry_mode_flags = HD44780_INCREASE_CURSOR_ON
+	};
+
+	hd44780_init(&config);
+	sim_time = (bench_time_t){0};
+
+	for (size_t i = 0; i < BENCH_REDRAWS_NUM; ++i) {
+		redraw((i & 1) ? 'A' : 'B');
+	}
+
+	const double us = (double)sim_time.us / BENCH_REDRAWS_NUM;
+	const double legacy_min_us = (double)sim_time.legacy_min_us / BENCH_REDRAWS_NUM;
+	const double legacy_max_us = (double)sim_time.legacy_max_us / BENCH_REDRAWS_NUM;
+
+	printf("Full %u-cell redraw, time spent in delays:\n", BENCH_DISPLAY_CELLS);
+	printf("  delay_us(): %.0f us\n", us);
+	printf("  millisecond delays: %.0f - %.0f us (%.0fx - %.0fx slower)\n", legacy_min_us, legacy_max_us, legacy_min_us / us, legacy_max_us / us);
+
+	/* Microsecond path must never wait less than the display needs, nor anywhere near a millisecond per byte */
+	return ((us > 0) && (us < legacy_min_us)) ? 0 : 1;
+}
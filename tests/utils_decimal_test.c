@@ -0,0 +1,140 @@
+#include <utils.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+
+/* Frequency field as shown by the GUI */
+#define TEST_FREQ_MAX_VALUE 9999999
+#define TEST_FREQ_DIGITS_NUM 7
+#define TEST_FREQ_COMMA_1_POS 0
+#define TEST_FREQ_COMMA_2_POS 3
+
+typedef uint32_t (*divide_t)(uint32_t dividend, uint32_t divisor, uint32_t *remainder);
+
+static uint32_t divide_hw(uint32_t dividend, uint32_t divisor, uint32_t *remainder)
+{
+	*remainder = dividend % divisor;
+
+	return dividend / divisor;
+}
+
+/* Restoring division as done by libgcc __udivsi3 on cores without M extension */
+static uint32_t divide_sw(uint32_t dividend, uint32_t divisor, uint32_t *remainder)
+{
+	uint32_t quotient = 0;
+	uint32_t rest = 0;
+
+	for (int bit = 31; bit >= 0; --bit) {
+		rest = (rest << 1) | ((dividend >> bit) & 1);
+		if (rest >= divisor) {
+			rest -= divisor;
+			quotient |= (1UL << bit);
+		}
+	}
+	*remainder = rest;
+
+	return quotient;
+}
+
+static uint32_t legacy_powu(uint32_t base, uint32_t exp)
+{
+	uint32_t result = 1;
+
+	while (exp > 0) {
+		if (exp & 0x00000001) {
+			result *= base;
+		}
+		base *= base;
+		exp >>= 1;
+	}
+
+	return result;
+}
+
+/* Frequency rendering before utils_format_decimal(), one divide and modulo per digit */
+static size_t legacy_format_frequency(char *buffer, uint32_t value, bool show_zeros, divide_t divide)
+{
+	bool leading_zeros_end = false;
+	size_t length = 0;
+	uint32_t remainder;
+
+	for (size_t i = 0; i < TEST_FREQ_DIGITS_NUM; ++i) {
+		const uint32_t divisor = legacy_powu(10, TEST_FREQ_DIGITS_NUM - 1 - i);
+		divide(divide(value, divisor, &remainder), 10, &remainder);
+		const uint8_t digit = remainder;
+
+		if (digit != 0) {
+			leading_zeros_end = true;
+		}
+		if ((divisor == 1) || show_zeros || leading_zeros_end) {
+			buffer[length++] = digit + '0';
+		}
+		if (((i == TEST_FREQ_COMMA_1_POS) || (i == TEST_FREQ_COMMA_2_POS)) && (show_zeros || leading_zeros_end)) {
+			buffer[length++] = ',';
+		}
+	}
+	buffer[length] = '\0';
+
+	return length;
+}
+
+static bool test_equivalence(bool show_zeros)
+{
+	char expected[UTILS_DEC_STR_SIZE(TEST_FREQ_DIGITS_NUM)];
+	char actual[UTILS_DEC_STR_SIZE(TEST_FREQ_DIGITS_NUM)];
+	uint32_t mismatches = 0;
+
+	for (uint32_t value = 0; value <= TEST_FREQ_MAX_VALUE; ++value) {
+		legacy_format_frequency(expected, value, show_zeros, divide_hw);
+		utils_format_decimal(actual, value, TEST_FREQ_DIGITS_NUM, show_zeros, ',');
+
+		if (strcmp(expected, actual) != 0) {
+			if (mismatches == 0) {
+				printf("  first mismatch at %u: got \"%s\", expected \"%s\"\n", value, actual, expected);
+			}
+			++mismatches;
+		}
+	}
+
+	printf("Frequency, %s zeros, exhaustive: %u mismatches - %s\n", show_zeros ? "leading" : "no leading",
+		   mismatches, (mismatches == 0) ? "PASS" : "FAIL");
+
+	return (mismatches == 0);
+}
+
+static double bench_legacy(divide_t divide)
+{
+	char buffer[UTILS_DEC_STR_SIZE(TEST_FREQ_DIGITS_NUM)];
+	const uint64_t start = bench_now_ns();
+
+	for (uint32_t value = 0; value <= TEST_FREQ_MAX_VALUE; ++value) {
+		bench_sink = legacy_format_frequency(buffer, value, false, divide);
+	}
+
+	return (double)(bench_now_ns() - start) / (TEST_FREQ_MAX_VALUE + 1);
+}
+
+static double bench_format(void)
+{
+	char buffer[UTILS_DEC_STR_SIZE(TEST_FREQ_DIGITS_NUM)];
+	const uint64_t start = bench_now_ns();
+
+	for (uint32_t value = 0; value <= TEST_FREQ_MAX_VALUE; ++value) {
+		bench_sink = utils_format_decimal(buffer, value, TEST_FREQ_DIGITS_NUM, false, ',');
+	}
+
+	return (double)(bench_now_ns() - start) / (TEST_FREQ_MAX_VALUE + 1);
+}
+
+int main(void)
+{
+	bool passed = test_equivalence(false);
+	passed = test_equivalence(true) && passed;
+
+	/* Software divide stands in for the missing divider on RV32EC, host one is a single instruction */
+	printf("Legacy, hardware divide: %.2f ns per value on host\n", bench_legacy(divide_hw));
+	printf("Legacy, software divide: %.2f ns per value on host\n", bench_legacy(divide_sw));
+	printf("utils_format_decimal(): %.2f ns per value on host\n", bench_format());
+
+	return passed ? 0 : 1;
+}
@@ -1,12 +1,21 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 #define UTILS_MIN(x, y) (((x) < (y)) ? (x) : (y))
 #define UTILS_MAX(x, y) (((x) > (y)) ? (x) : (y))
 
 #define UTILS_CLAMP(x, lo, hi) UTILS_MIN(hi, UTILS_MAX(lo, x))
 
+#define UTILS_LN2 0.69314718f
+
+#define UTILS_DEC_MAX_DIGITS 10 // uint32_t has at most 10 decimal digits - 4294967295
+#define UTILS_DEC_GROUP_SIZE 3
+/* Buffer size needed by utils_format_decimal() - digits, separators and null-terminator */
+#define UTILS_DEC_STR_SIZE(digits_num) ((digits_num) + (((digits_num) - 1) / UTILS_DEC_GROUP_SIZE) + 1)
+
 /* Use to place RODATA that should not get removed at linking stage (e.g. version string).
  * Keep in sync with linker script, KEEP(*(.rodata_keep)) should be present in .rodata
  * section for this to work.  */
@@ -32,19 +41,121 @@ inline static float utils_roundf(float x)
 	}
 }
 
-inline static uint32_t utils_powu(uint32_t base, uint32_t exp)
+/* Power of ten without multiplication, exp has to be lower than UTILS_DEC_MAX_DIGITS */
+inline static uint32_t utils_pow10(size_t exp)
+{
+	static const uint32_t powers[UTILS_DEC_MAX_DIGITS] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+	};
+
+	return powers[exp];
+}
+
+/* Splits value into decimal digits, most significant first, by subtracting powers of ten.
+ * RV32EC has no hardware divider, so this avoids a libgcc division and modulo per digit.
+ * At most 9 subtractions per digit, value has to fit in digits_num digits. */
+inline static void utils_to_decimal(uint32_t value, uint8_t *digits, size_t digits_num)
+{
+	for (size_t i = 0; i < digits_num; ++i) {
+		const uint32_t power = utils_pow10(digits_num - i - 1);
+		uint8_t digit = 0;
+
+		while (value >= power) {
+			value -= power;
+			++digit;
+		}
+		digits[i] = digit;
+	}
+}
+
+/* Formats value as null-terminated string of at most digits_num digits, with separator
+ * (if not '\0') between groups of three. Leading zeros and separators preceding them are either
+ * kept or skipped, the last digit is always shown. Returns length of the string. */
+inline static size_t utils_format_decimal(char *buffer, uint32_t value, size_t digits_num, bool leading_zeros, char separator)
+{
+	uint8_t digits[UTILS_DEC_MAX_DIGITS];
+	bool significant = leading_zeros;
+	size_t length = 0;
+
+	digits_num = UTILS_CLAMP(digits_num, 1, UTILS_DEC_MAX_DIGITS);
+	utils_to_decimal(value, digits, digits_num);
+
+	/* Digits left in the current group, counted down to avoid modulo */
+	size_t group_left = digits_num;
+	while (group_left > UTILS_DEC_GROUP_SIZE) {
+		group_left -= UTILS_DEC_GROUP_SIZE;
+	}
+
+	for (size_t i = 0; i < digits_num; ++i) {
+		const bool last = (i == (digits_num - 1));
+
+		if ((digits[i] != 0) || last) {
+			significant = true;
+		}
+		if (significant) {
+			buffer[length++] = digits[i] + '0';
+		}
+
+		--group_left;
+		if (group_left == 0) {
+			if (significant && !last && (separator != '\0')) {
+				buffer[length++] = separator;
+			}
+			group_left = UTILS_DEC_GROUP_SIZE;
+		}
+	}
+	buffer[length] = '\0';
+
+	return length;
+}
+
+#define UTILS_CRC32_INIT 0xFFFFFFFF
+
+/* CRC-32 (IEEE 802.3, reflected), bitwise to avoid a 1 KB table on 16 KB part. Start with
+ * UTILS_CRC32_INIT and invert the result after the last chunk. */
+inline static uint32_t utils_crc32_update(uint32_t crc, const void *data, size_t size)
 {
-	uint32_t result = 1;
+	const uint8_t *bytes = data;
 
-	while (exp > 0) {
-		if (exp & 0x00000001) {
-			result *= base;
+	for (size_t i = 0; i < size; ++i) {
+		crc ^= bytes[i];
+		for (size_t bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
 		}
-		base *= base;
-		exp >>= 1;
 	}
 
-	return result;
+	return crc;
+}
+
+/* Natural logarithm, x has to be positive */
+inline static float utils_logf(float x)
+{
+	union { float f; uint32_t u; } conv = {.f = x};
+
+	/* Split into exponent and mantissa in <1; 2) range */
+	const int32_t exponent = (int32_t)((conv.u >> 23) & 0xFF) - 127;
+	conv.u = (conv.u & 0x007FFFFF) | 0x3F800000;
+
+	/* ln(m) = 2 * atanh(z), where z = (m - 1) / (m + 1) is at most 1/3, so the series converges quickly */
+	const float z = (conv.f - 1.0f) / (conv.f + 1.0f);
+	const float z2 = z * z;
+	const float atanh = z * (1.0f + z2 * (1.0f / 3 + z2 * (1.0f / 5 + z2 * (1.0f / 7 + z2 * (1.0f / 9)))));
+
+	return exponent * UTILS_LN2 + 2.0f * atanh;
+}
+
+/* Exponential function, valid for results within normal float range */
+inline static float utils_expf(float x)
+{
+	/* exp(x) = 2^k * exp(r), where |r| <= ln(2) / 2 */
+	const int32_t k = (int32_t)(x / UTILS_LN2 + ((x >= 0.0f) ? 0.5f : -0.5f));
+	const float r = x - k * UTILS_LN2;
+	const float taylor = 1.0f + r * (1.0f + r * (1.0f / 2 + r * (1.0f / 6 + r * (1.0f / 24 + r * (1.0f / 120 + r * (1.0f / 720))))));
+
+	/* Build 2^k directly in the exponent field */
+	union { float f; uint32_t u; } conv = {.u = (uint32_t)(UTILS_CLAMP(k, -126, 127) + 127) << 23};
+
+	return taylor * conv.f;
 }
 
 /* Wraps phase value to 0-360 range */